@@ -1,88 +1,915 @@
 ﻿#pragma once
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include <nmmintrin.h>
 
+#include <boost/container/static_vector.hpp>
 #include <boost/range/algorithm.hpp>
 
+#include "evaluation.hpp"
+#include "evaluation_batch.hpp"
 #include "game.hpp"
+#include "move.hpp"
+#include "move_ordering.hpp"
+#include "position.hpp"
+#include "search_control.hpp"
+#include "search_trace.hpp"
+#include "tablebase.hpp"
+#include "transposition_table.hpp"
 
 namespace barys {
-  class alpha_beta final {
+  // 選択的探索の設定。効果を測れるように、それぞれ無効にできます。
+
+  struct search_options final {
+    bool is_principal_variation_search_enabled = true;
+    bool is_aspiration_window_enabled          = true;
+    bool is_null_move_pruning_enabled          = true;
+    bool is_late_move_reduction_enabled        = true;
+    bool is_batch_evaluation_enabled           = false;  // 実験的な機能です。深さ1のノードの子の局面を一括評価しますが、βカットで探索しない子も評価するので探索は遅くなります（組み込みの局面の深さ9で約2倍）。既定では使いません。
+  };
+
+  // 反復深化のアルファ・ベータ探索。Rulesはbasic_rulesで、ルール毎に専用の探索が生成されます。終盤データベースはBarium（barium_rules）の場合だけ使用します。
+
+  template <typename Rules>
+  class basic_alpha_beta final {
+    using state         = basic_state<Rules>;
+    using position      = basic_position<Rules>;
+    using move          = basic_move<Rules>;
+    using move_stack    = basic_move_stack<Rules>;
+    using move_list     = basic_move_list<Rules>;
+    using move_ordering = basic_move_ordering<Rules>;
+
+    static constexpr auto has_tablebases = std::is_same_v<Rules, barium_rules>;
+
+    // 探索スレッド毎の状態。置換表だけを共有します（Lazy SMP）。
+
+    class searcher final {
+      search_control& _search_control;
+      transposition_table& _transposition_table;
+      const tablebase* _tablebase;
+      const search_options& _options;
+      move_stack _move_stack;
+      move_ordering _move_ordering;
+      basic_evaluation_batch<Rules> _evaluation_batch;
+      bool _is_timeout;
+      int _check_countdown;
+      std::uint64_t _check_count;
+      std::uint64_t _node_count;
+      std::uint64_t _quiescence_node_count;
+      std::uint64_t _probe_count;
+      std::uint64_t _hit_count;
+      std::uint64_t _store_count;
+      std::uint64_t _collision_count;
+      std::uint64_t _cutoff_count;
+      std::uint64_t _first_move_cutoff_count;
+      std::uint64_t _null_move_count;
+      std::uint64_t _null_move_cutoff_count;
+      std::uint64_t _reduction_count;
+      std::uint64_t _reduction_research_count;
+      std::uint64_t _principal_variation_research_count;
+      std::uint64_t _tablebase_hit_count;
+
+#ifdef BARYS_SEARCH_TRACE
+      std::array<std::uint64_t, search_trace::cutoff_index_count> _cutoff_indices;
+#endif
+
+    public:
+      searcher(search_control& search_control, transposition_table& transposition_table, const tablebase* tablebase, const search_options& options) noexcept
+        : _search_control(search_control), _transposition_table(transposition_table), _tablebase(tablebase), _options(options), _move_stack(), _move_ordering(), _evaluation_batch(), _is_timeout(false), _check_countdown(search_control::check_interval), _check_count(0), _node_count(0), _quiescence_node_count(0), _probe_count(0), _hit_count(0), _store_count(0), _collision_count(0), _cutoff_count(0), _first_move_cutoff_count(0), _null_move_count(0), _null_move_cutoff_count(0), _reduction_count(0), _reduction_research_count(0), _principal_variation_research_count(0), _tablebase_hit_count(0)
+#ifdef BARYS_SEARCH_TRACE
+        , _cutoff_indices()
+#endif
+      {
+        ;
+      }
+
+    private:
+      static constexpr auto no_evaluation = std::numeric_limits<int>::min();  // 一括評価していない場合のstatic_evaluationです。
+
+      // 手で得られる駒の点数の上限。取った駒は持ち駒になるので、盤上の駒の点数と持ち駒の点数の両方が入ります。
+
+      auto gain(const position& position, const move& move) const noexcept {
+        static constexpr auto piece_scores = []() {  // ライオンは、取れば勝ちです。
+          auto result = std::array<int, Rules::piece_count>();
+
+          for (auto i = 0; i < Rules::piece_count; ++i) {
+            result[i] = i == Rules::king ? 100000 : Rules::pieces[i].value;
+          }
+
+          return result;
+        }();
+
+        if (move.is_drop()) {
+          return 0;
+        }
+
+        auto result = 0;
+
+        const auto& captured_piece_type = position.enemy_piece_type_at(move.to());
+
+        if (captured_piece_type >= 0) {
+          result += piece_scores[captured_piece_type] + piece_scores[Rules::demoted_pieces[captured_piece_type]];
+        }
+
+        if (move.is_promotion()) {
+          const auto& moved_piece_type = position.piece_type_at(move.from());
+
+          result += piece_scores[Rules::promoted_pieces[moved_piece_type]] - piece_scores[moved_piece_type];
+        }
+
+        return result;
+      }
+
+      auto store(std::uint64_t key, int score, const move& move, int depth, bound_type bound) noexcept {
+        _store_count++;
+
+        if (_transposition_table.store(key, score, move, depth, bound)) {
+          _collision_count++;
+        }
+      }
+
+      // 時計と停止フラグを見るのは、check_intervalノードに1回だけです。
+
+      auto is_timeout_checked() noexcept {
+        if (--_check_countdown != 0) {
+          return false;
+        }
+
+        _check_countdown = search_control::check_interval;
+        _check_count++;
+
+        return _is_timeout = _search_control.check();
+      }
+
+      // 静止探索。駒を取る手と成る手だけを探索して、駒の取り合いの途中で評価しないようにします。
+      // static_evaluationは、親のノードで一括評価した場合の評価値です。
+
+      auto quiescence(position& position, int ply, int alpha, int beta, int static_evaluation = no_evaluation) noexcept {
+        _quiescence_node_count++;
+
+        if (is_timeout_checked()) {
+          return alpha;
+        }
+
+        if (position.is_end()) {
+          return -100000;
+        }
+
+        if constexpr (has_tablebases) {
+          if (_tablebase) {
+            _tablebase_hit_count++;
+
+            return tablebase::score(_tablebase->probe(position));
+          }
+        }
+
+        const auto& stand_pat = static_evaluation != no_evaluation ? static_evaluation : evaluate(position, alpha, beta);  // 取り合いに応じずに、今の局面で止めることもできます。
+
+        if (stand_pat >= beta) {
+          return stand_pat;
+        }
+
+        alpha = std::max(alpha, stand_pat);
+
+        auto moves  = move_list(_move_stack, [&](auto result) { return position.generate_capture_moves(result); });
+        auto scores = moves.scores();
+
+        _move_ordering.score(position, moves, scores, move(), ply);
+
+        for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+          move_ordering::pick(moves, scores, i);
+
+          const auto& move = moves[i];
+
+          if (stand_pat + gain(position, move) + 200 <= alpha) {  // デルタ枝刈り。駒を丸得しても届かない手は探索しません。
+            continue;
+          }
+
+          const auto& undo  = position.make(move);
+          const auto& score = -quiescence(position, ply + 1, -beta, -alpha);
+
+          position.unmake(undo);
+
+          if (_is_timeout) {
+            return alpha;
+          }
+
+          if (score > alpha) {
+            alpha = score;
+          }
+
+          if (alpha >= beta) {
+            return alpha;
+          }
+        }
+
+        return alpha;
+      }
+
+      // 持ち駒があれば打つ手があるので、どうぶつしょうぎではツークツワンク（パスできれば助かる局面）はまず起きません。
+      // 持ち駒がなくて盤上の駒も少ない場合だけは危ないので、null moveを使用しません。
+
+      auto is_null_move_safe(const position& position) const noexcept {
+        for (const auto& count: position.piece_counts_in_hand(position.side())) {
+          if (count) {
+            return true;
+          }
+        }
+
+        auto piece_count = 0;
+
+        for (auto i = 0; i < Rules::piece_count; ++i) {
+          if (i != Rules::king) {
+            piece_count += static_cast<int>(_mm_popcnt_u32(position.pieces_on_board(position.side())[i]));
+          }
+        }
+
+        return piece_count >= 2;
+      }
+
+    public:
+      // 局面はmakeとunmakeで更新するので、戻った時には呼び出し前と同じ局面になっています。
+
+      auto score(position& position, int depth, int ply, int alpha, int beta, bool is_null_move_allowed = true, int static_evaluation = no_evaluation) noexcept {
+        if (depth == 0) {
+          return quiescence(position, ply, alpha, beta, static_evaluation);
+        }
+
+        _node_count++;
+
+        if (is_timeout_checked()) {
+          return alpha;
+        }
+
+        if (position.is_end()) {
+          return -100000;
+        }
+
+        // 終盤データベースの駒の組み合わせなら、データベースの値が正解です。駒の数は減らないので、探索開始時の局面で引けたなら全ての局面で引けます。
+
+        if constexpr (has_tablebases) {
+          if (_tablebase) {
+            _tablebase_hit_count++;
+
+            return tablebase::score(_tablebase->probe(position));
+          }
+        }
+
+        _probe_count++;
+
+        const auto& entry = _transposition_table.probe(position.hash());
+
+        if (entry) {
+          _hit_count++;
+        }
+
+        if (entry && entry->depth() >= depth) {
+          switch (entry->bound()) {
+          case bound_type::exact:
+            return entry->score();
+
+          case bound_type::lower:
+            if (entry->score() >= beta) {
+              return entry->score();
+            }
+
+            break;
+
+          case bound_type::upper:
+            if (entry->score() <= alpha) {
+              return entry->score();
+            }
+
+            break;
+
+          default:
+            break;
+          }
+        }
+
+        const auto& is_checked = position.is_checked();
+
+        // null move枝刈り。パスして相手に浅く探索させてもbeta以上なら、探索するまでもなくカットできます。王手の場合と、null moveが連続する場合はパスしません。
+
+        if (_options.is_null_move_pruning_enabled && is_null_move_allowed && depth >= 3 && std::abs(beta) < 100000 && !is_checked && is_null_move_safe(position) && evaluate(position, beta - 1, beta) >= beta) {
+          _null_move_count++;
+
+          position.make_null();
+
+          const auto& score = -searcher::score(position, depth - 1 - (depth >= 6 ? 3 : 2), ply + 1, -beta, -beta + 1, false);
+
+          position.unmake_null();
+
+          if (_is_timeout) {
+            return alpha;
+          }
+
+          if (score >= beta) {
+            _null_move_cutoff_count++;
+
+            return beta;
+          }
+        }
+
+        auto moves = move_list(_move_stack, [&](auto result) { return position.generate_moves(result); });
+
+        if (moves.empty()) {
+          return alpha;
+        }
+
+        auto scores = moves.scores();
+
+        _move_ordering.score(position, moves, scores, entry ? entry->template move<move>() : move(), ply);
+
+        move_ordering::pick(moves, scores, 0);
+
+        // 深さ1のノードでは、子の局面は全て静止探索の評価から始まるので、まとめて評価しておきます（実験的な機能です）。
+        // 遅延評価の窓は今の(alpha, beta)で決めます。後でalphaが上がっても子の窓は狭くなるだけなので、求めた値は子の窓でも正しい上限か下限で、静止探索で使えます。
+        // ただし、子の窓で評価した場合と同じ値になるとは限らないので（fail-softの値が変わります）、静止探索のノード数や評価値は一括評価しない場合と少し違うことがあります。
+
+        const auto& is_batch_evaluated = _options.is_batch_evaluation_enabled && depth == 1;
+
+        if (is_batch_evaluated) {
+          _evaluation_batch.clear();
+
+          for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+            const auto& undo = position.make(moves[i]);
+
+            _evaluation_batch.add(position, moves[i], -beta, -alpha);
+
+            position.unmake(undo);
+          }
+
+          _evaluation_batch.evaluate(position.weights());
+        }
+
+        const auto original_alpha = alpha;
+        auto best_move = moves[0];
+
+        for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+          move_ordering::pick(moves, scores, i);
+
+          const auto& move = moves[i];
+
+          // late move reduction。置換表の手、駒を取る手、キラー手より後ろの手は、良い手ではないだろうと考えて浅く探索します。
+
+          const auto& is_reducible = _options.is_late_move_reduction_enabled && depth >= 3 && i >= 3 && scores[i] < move_ordering::killer_score && !is_checked && gain(position, move) == 0;
+          const auto& reduction    = is_reducible ? (depth >= 6 && i >= 8 ? 2 : 1) : 0;
+
+          const auto& undo  = position.make(move);
+          const auto& score = child_score(position, i, depth, ply, alpha, beta, reduction, is_batch_evaluated ? _evaluation_batch.score(move) : no_evaluation);
+
+          position.unmake(undo);
+
+          if (_is_timeout) {  // 時間切れの場合の値は信用できないので、置換表に記録しません。
+            return alpha;
+          }
+
+          if (score > alpha) {
+            alpha = score;
+
+            best_move = move;
+          }
+
+          if (alpha >= beta) {
+            _cutoff_count++;
+
+            if (i == 0) {
+              _first_move_cutoff_count++;
+            }
+
+#ifdef BARYS_SEARCH_TRACE
+            _cutoff_indices[std::min(i, search_trace::cutoff_index_count - 1)]++;
+#endif
+
+            _move_ordering.update(position, move, depth, ply);
+
+            store(position.hash(), alpha, best_move, depth, bound_type::lower);
+
+            return alpha;
+          }
+        }
+
+        store(position.hash(), alpha, best_move, depth, alpha > original_alpha ? bound_type::exact : bound_type::upper);
+
+        return alpha;
+      }
+
+      // makeした後の局面を探索します。indexは手の順番、depthは親の深さ、static_evaluationは一括評価した場合の子の局面の評価値です。
+      // 2手目以降はnull windowで探索して（principal variation search）、alphaを超えた場合だけ普通の窓で探索し直します。減らした深さで探索した場合も、alphaを超えたら深さを戻して探索し直します。
+
+      int child_score(position& position, int index, int depth, int ply, int alpha, int beta, int reduction, int static_evaluation = no_evaluation) noexcept {
+        if (reduction > 0) {
+          _reduction_count++;
+
+          const auto& score = -searcher::score(position, depth - 1 - reduction, ply + 1, -alpha - 1, -alpha, true, static_evaluation);
+
+          if (_is_timeout || score <= alpha) {
+            return score;
+          }
+
+          _reduction_research_count++;
+        }
+
+        if (index == 0 || !_options.is_principal_variation_search_enabled) {
+          return -searcher::score(position, depth - 1, ply + 1, -beta, -alpha, true, static_evaluation);
+        }
+
+        const auto& score = -searcher::score(position, depth - 1, ply + 1, -alpha - 1, -alpha, true, static_evaluation);
+
+        if (_is_timeout || score <= alpha || score >= beta) {
+          return score;
+        }
+
+        _principal_variation_research_count++;
+
+        return -searcher::score(position, depth - 1, ply + 1, -beta, -alpha, true, static_evaluation);
+      }
+
+      const auto& is_timeout() const noexcept {
+        return _is_timeout;
+      }
+
+      auto check_count() const noexcept {
+        return _check_count;
+      }
+
+      auto node_count() const noexcept {
+        return _node_count;
+      }
+
+      auto quiescence_node_count() const noexcept {
+        return _quiescence_node_count;
+      }
+
+      auto probe_count() const noexcept {
+        return _probe_count;
+      }
+
+      auto hit_count() const noexcept {
+        return _hit_count;
+      }
+
+      auto store_count() const noexcept {
+        return _store_count;
+      }
+
+      auto collision_count() const noexcept {
+        return _collision_count;
+      }
+
+      auto cutoff_count() const noexcept {
+        return _cutoff_count;
+      }
+
+      auto first_move_cutoff_count() const noexcept {
+        return _first_move_cutoff_count;
+      }
+
+      auto null_move_count() const noexcept {
+        return _null_move_count;
+      }
+
+      auto null_move_cutoff_count() const noexcept {
+        return _null_move_cutoff_count;
+      }
+
+      auto reduction_count() const noexcept {
+        return _reduction_count;
+      }
+
+      auto reduction_research_count() const noexcept {
+        return _reduction_research_count;
+      }
+
+      auto principal_variation_research_count() const noexcept {
+        return _principal_variation_research_count;
+      }
+
+      auto tablebase_hit_count() const noexcept {
+        return _tablebase_hit_count;
+      }
+
+#ifdef BARYS_SEARCH_TRACE
+      const auto& cutoff_indices() const noexcept {
+        return _cutoff_indices;
+      }
+#endif
+    };
+
+  public:
+    // 完了した反復の記録です。
+
+    struct iteration final {
+      int depth;
+      int score;
+      std::uint64_t node_count;
+      std::uint64_t quiescence_node_count;
+      std::chrono::steady_clock::duration time;
+    };
+
+  private:
     const state& _state;
-    const std::chrono::system_clock::time_point& _time_limit;
+    search_control& _search_control;
+    transposition_table& _transposition_table;
+    const tablebase* _tablebase;
+    int _thread_count;
+    int _depth_limit;
+    search_options _options;
+    std::vector<searcher> _searchers;
+    std::chrono::steady_clock::duration _time;
+    int _completed_depth;
+    int _best_score;
+    double _effective_branching_factor;
+    std::vector<iteration> _iterations;
+    std::uint64_t _aspiration_research_count;
+
+#ifdef BARYS_SEARCH_TRACE
+    search_trace _trace;
+#endif
 
   public:
-    alpha_beta(const state& state, const std::chrono::system_clock::time_point& time_limit) noexcept: _state(state), _time_limit(time_limit) {
+    static constexpr auto max_depth = 64;
+
+    basic_alpha_beta(const state& state, search_control& search_control, transposition_table& transposition_table, int thread_count = 1, int depth_limit = max_depth, const search_options& options = search_options()) noexcept
+      : _state(state), _search_control(search_control), _transposition_table(transposition_table), _tablebase(find_tablebase(state)), _thread_count(std::max(thread_count, 1)), _depth_limit(std::min(depth_limit, max_depth)), _options(options), _searchers(), _time(), _completed_depth(0), _best_score(0), _effective_branching_factor(0), _iterations(), _aspiration_research_count(0)
+#ifdef BARYS_SEARCH_TRACE
+      , _trace()
+#endif
+    {
       ;
     }
 
   private:
-    auto board_score(const std::array<std::uint32_t, 6>& pieces_on_board) const noexcept {
-      return static_cast<int>(_mm_popcnt_u32(pieces_on_board[static_cast<int>(piece_type::chick)])        *  100 +
-                              _mm_popcnt_u32(pieces_on_board[static_cast<int>(piece_type::cat)])          * 1000 +
-                              _mm_popcnt_u32(pieces_on_board[static_cast<int>(piece_type::dog)])          * 1200 +
-                              _mm_popcnt_u32(pieces_on_board[static_cast<int>(piece_type::chicken)])      * 1200 +
-                              _mm_popcnt_u32(pieces_on_board[static_cast<int>(piece_type::power_up_cat)]) * 1200);
-    };
+    static auto find_tablebase(const state& state) noexcept -> const tablebase* {
+      if constexpr (has_tablebases) {
+        return current_tablebases().find(position(state));
+      } else {
+        return nullptr;
+      }
+    }
 
-    auto hand_score(const std::array<int, 4>& piece_counts_in_hand) const noexcept {
-      return (piece_counts_in_hand[static_cast<int>(piece_type::chick)] *  100 +
-              piece_counts_in_hand[static_cast<int>(piece_type::cat)]   * 1000 +
-              piece_counts_in_hand[static_cast<int>(piece_type::dog)]   * 1200);
-    };
+    template <typename Moves>
+    auto search(searcher& searcher, const Moves& moves, int depth, int alpha = -1000000, int beta = 1000000) noexcept {
+      auto best_move = moves.front();
+
+      auto position = basic_alpha_beta::position(_state);  // スレッド毎に別の局面を使います。
+
+      for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+        const auto& move = moves[i];
+
+        const auto& undo  = position.make(move);
+        const auto& score = searcher.child_score(position, i, depth, 0, alpha, beta, 0);
+
+        position.unmake(undo);
+
+        if (searcher.is_timeout()) {
+          break;
+        }
+
+        if (score > alpha) {
+          alpha = score;
+
+          best_move = move;
+        }
+
+        if (alpha >= beta) {
+          break;
+        }
+      }
 
-    auto evaluate(const state& state) const noexcept {
-      return board_score(state.pieces_on_board()) - board_score(state.enemy_pieces_on_board()) + hand_score(state.piece_counts_in_hand()) - hand_score(state.enemy_piece_counts_in_hand());
+      return std::make_pair(best_move, alpha);
     }
 
-    auto score(const state& state, int depth, int alpha, int beta) const noexcept {
-      if (std::chrono::system_clock::now() > _time_limit) {
-        return alpha;
+    // 前の反復の評価値の周りの狭い窓で探索します（aspiration window）。窓の外になった場合は、窓を広げて探索し直します。
+
+    template <typename Moves>
+    auto aspiration_search(searcher& searcher, const Moves& moves, int depth) noexcept {
+      if (!_options.is_aspiration_window_enabled || depth < 4 || std::abs(_best_score) >= 100000) {
+        return search(searcher, moves, depth);
       }
 
-      if (state.is_end()) {
-        return -100000;
+      auto window = 200;
+      auto alpha  = _best_score - window;
+      auto beta   = _best_score + window;
+
+      for (;;) {
+        const auto& result = search(searcher, moves, depth, alpha, beta);
+
+        if (searcher.is_timeout() || ((result.second > alpha || alpha == -1000000) && (result.second < beta || beta == 1000000))) {
+          return result;
+        }
+
+        _aspiration_research_count++;
+
+        window *= 4;
+
+        if (result.second <= alpha) {
+          alpha = std::max(result.second - window, -1000000);
+        } else {
+          beta  = std::min(result.second + window,  1000000);
+        }
       }
+    }
+
+    template <typename Moves>
+    auto help(searcher& searcher, Moves moves, int thread_index) noexcept {
+      // 補助スレッドは、手の順序と開始する深さを変えて同じ局面を探索します。結果は置換表経由でメイン・スレッドに伝わります。
 
-      if (depth == 0) {
-        return evaluate(state);
+      std::shuffle(std::begin(moves), std::end(moves), std::mt19937(thread_index));
+
+      for (auto depth = 1 + thread_index % 2; depth <= _depth_limit; ++depth) {
+        const auto& result = search(searcher, moves, depth);
+
+        if (searcher.is_timeout()) {
+          break;
+        }
+
+        const auto& it = boost::find(moves, result.first);
+        std::rotate(std::begin(moves), it, std::next(it));
       }
+    }
 
-      for (const auto& action: state.actions()) {
-        const auto& score = -alpha_beta::score(state.next(action), depth - 1, -beta, -alpha);
+#ifdef BARYS_SEARCH_TRACE
+    // 読み筋を取り出します。ルートの局面は置換表に保存しないので、その反復の最善手から始めて、その後は置換表の最善手を辿ります。ハッシュ値の衝突で合法手ではない手が入っている場合は、そこまでにします。
 
-        if (score > alpha) {
-          alpha = score;
+    auto principal_variation(const move& best_move, int length) const {
+      auto result = std::vector<action>{best_move.action()};
+      auto state  = _state.next(best_move.action());
+
+      for (auto i = 1; i < length && !state.is_end(); ++i) {
+        const auto& entry = _transposition_table.probe(state.hash());
+
+        if (!entry) {
+          break;
         }
 
-        if (alpha >= beta) {
-          return alpha;
+        const auto& actions = state.actions();
+
+        if (boost::find(actions, entry->template move<move>().action()) == std::end(actions)) {
+          break;
         }
+
+        result.emplace_back(entry->template move<move>().action());
+        state = state.next(result.back());
       }
 
-      return alpha;
+      return result;
     }
+#endif
 
   public:
-    auto operator()() const noexcept {
-      auto result = action();
+    auto operator()() noexcept {
+      const auto& search_starting_time = std::chrono::steady_clock::now();
 
-      auto alpha = -1000000;
+#ifdef BARYS_SEARCH_TRACE
+      _trace.stop_reason = stop_reason::depth_limit;
+#endif
 
-      for (const auto& action: [&]() { auto result = _state.actions(); return boost::random_shuffle(result); }()) {
-        const auto& score = -alpha_beta::score(_state.next(action), 6, -1000000, -alpha);
+      _transposition_table.new_search();
 
-        if (score > alpha) {
-          alpha = score;
+      const auto& root_position = position(_state);
+
+      auto moves = boost::container::static_vector<move, move_stack::max_move_count>(move_stack::max_move_count);
+      moves.resize(root_position.generate_moves(moves.data()));
+
+      move_ordering().sort(root_position, moves, move(), 0);
+
+      if (moves.size() == 1) {  // 他に選択肢がないなら、考えても無駄です。
+#ifdef BARYS_SEARCH_TRACE
+        _trace.stop_reason = stop_reason::single_move;
+#endif
+
+        return moves.front().action();
+      }
+
+      _searchers.reserve(_thread_count);
+
+      for (auto i = 0; i < _thread_count; ++i) {
+        _searchers.emplace_back(_search_control, _transposition_table, _tablebase, _options);
+      }
+
+      auto helper_threads = std::vector<std::thread>();
+
+      for (auto i = 1; i < _thread_count; ++i) {
+        helper_threads.emplace_back([&, i, moves]() { help(_searchers[i], moves, i); });
+      }
+
+      auto result = moves.front();
+
+      auto previous_node_count = std::uint64_t(0);
 
-          result = action;
+      for (auto depth = 1; depth <= _depth_limit; ++depth) {
+        const auto& starting_time                  = std::chrono::steady_clock::now();
+        const auto& starting_node_count            = _searchers[0].node_count();
+        const auto& starting_quiescence_node_count = _searchers[0].quiescence_node_count();
+
+#ifdef BARYS_SEARCH_TRACE
+        const auto& starting_probe_count = _searchers[0].probe_count();
+        const auto& starting_hit_count   = _searchers[0].hit_count();
+#endif
+
+        const auto& [best_move, alpha] = aspiration_search(_searchers[0], moves, depth);
+
+        if (_searchers[0].is_timeout()) {  // 途中で打ち切られた反復の結果は捨てて、最後に完了した深さの手を返します。
+#ifdef BARYS_SEARCH_TRACE
+          _trace.stop_reason      = stop_reason::timeout;
+          _trace.abort_depth      = depth;
+          _trace.abort_node_count = _searchers[0].node_count() - starting_node_count;
+          _trace.abort_time       = std::chrono::steady_clock::now() - search_starting_time;
+#endif
+
+          break;
+        }
+
+        result           = best_move;
+        _completed_depth = depth;
+        _best_score      = alpha;
+
+        const auto& it = boost::find(moves, best_move);
+        std::rotate(std::begin(moves), it, std::next(it));
+
+        const auto& node_count            = _searchers[0].node_count() - starting_node_count;
+        const auto& quiescence_node_count = _searchers[0].quiescence_node_count() - starting_quiescence_node_count;
+
+        _iterations.push_back(iteration{depth, alpha, node_count, quiescence_node_count, std::chrono::steady_clock::now() - starting_time});
+
+#ifdef BARYS_SEARCH_TRACE
+        _trace.iterations.push_back(iteration_trace{depth, alpha, node_count, quiescence_node_count, _searchers[0].probe_count() - starting_probe_count, _searchers[0].hit_count() - starting_hit_count, _iterations.back().time, principal_variation(best_move, depth)});
+#endif
+
+        if (previous_node_count) {
+          _effective_branching_factor = static_cast<double>(node_count) / previous_node_count;
         }
+
+        if (std::abs(alpha) >= 100000) {  // 勝ち負けが確定したなら、それ以上深く読む必要はありません。
+#ifdef BARYS_SEARCH_TRACE
+          _trace.stop_reason = stop_reason::decided;
+#endif
+
+          break;
+        }
+
+        if (_tablebase) {  // 終盤データベースの局面なら、子の局面の値は正確なので、1手読めば十分です。
+#ifdef BARYS_SEARCH_TRACE
+          _trace.stop_reason = stop_reason::tablebase;
+#endif
+
+          break;
+        }
+
+        // 有効分岐因子から次の深さの探索時間を見積もって、間に合いそうにないなら次の反復を始めません。
+
+        const auto& now = std::chrono::steady_clock::now();
+
+        const auto& effective_branching_factor = previous_node_count ? std::max(_effective_branching_factor, 2.0) : 8.0;
+
+        if (std::chrono::duration<double>(now - starting_time).count() * effective_branching_factor > std::chrono::duration<double>(_search_control.time_limit() - now).count()) {
+#ifdef BARYS_SEARCH_TRACE
+          _trace.stop_reason = stop_reason::time_estimate;
+#endif
+
+          break;
+        }
+
+        previous_node_count = node_count;
+      }
+
+      _search_control.stop();
+
+      for (auto& helper_thread: helper_threads) {
+        helper_thread.join();
+      }
+
+      _time = std::chrono::steady_clock::now() - search_starting_time;
+
+#ifdef BARYS_SEARCH_TRACE
+      for (const auto& searcher: _searchers) {
+        for (auto i = 0; i < search_trace::cutoff_index_count; ++i) {
+          _trace.cutoff_indices[i] += searcher.cutoff_indices()[i];
+        }
+      }
+#endif
+
+      return result.action();
+    }
+
+  private:
+    template <typename Function>
+    auto sum(Function function) const noexcept {
+      auto result = std::uint64_t(0);
+
+      for (const auto& searcher: _searchers) {
+        result += function(searcher);
       }
 
       return result;
     }
+
+  public:
+    auto node_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.node_count(); });
+    }
+
+    auto quiescence_node_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.quiescence_node_count(); });
+    }
+
+    auto check_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.check_count(); });
+    }
+
+    // 時計を読んだ時間の、全スレッドの探索時間に対する割合です。
+
+    auto check_overhead() const noexcept {
+      const auto& time = std::chrono::duration<double>(_time).count() * _thread_count;
+
+      return time > 0 ? check_count() * search_control::clock_read_time() / time : 0.0;
+    }
+
+    auto hit_rate() const noexcept {
+      const auto& probe_count = sum([](const auto& searcher) { return searcher.probe_count(); });
+
+      return probe_count ? static_cast<double>(sum([](const auto& searcher) { return searcher.hit_count(); })) / probe_count : 0.0;
+    }
+
+    auto collision_rate() const noexcept {
+      const auto& store_count = sum([](const auto& searcher) { return searcher.store_count(); });
+
+      return store_count ? static_cast<double>(sum([](const auto& searcher) { return searcher.collision_count(); })) / store_count : 0.0;
+    }
+
+    auto first_move_cutoff_rate() const noexcept {
+      const auto& cutoff_count = sum([](const auto& searcher) { return searcher.cutoff_count(); });
+
+      return cutoff_count ? static_cast<double>(sum([](const auto& searcher) { return searcher.first_move_cutoff_count(); })) / cutoff_count : 0.0;
+    }
+
+    auto null_move_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.null_move_count(); });
+    }
+
+    auto null_move_cutoff_rate() const noexcept {
+      const auto& null_move_count = basic_alpha_beta::null_move_count();
+
+      return null_move_count ? static_cast<double>(sum([](const auto& searcher) { return searcher.null_move_cutoff_count(); })) / null_move_count : 0.0;
+    }
+
+    auto reduction_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.reduction_count(); });
+    }
+
+    auto reduction_research_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.reduction_research_count(); });
+    }
+
+    auto principal_variation_research_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.principal_variation_research_count(); });
+    }
+
+    auto aspiration_research_count() const noexcept {
+      return _aspiration_research_count;
+    }
+
+    auto tablebase_hit_count() const noexcept {
+      return sum([](const auto& searcher) { return searcher.tablebase_hit_count(); });
+    }
+
+    auto effective_branching_factor() const noexcept {
+      return _effective_branching_factor;
+    }
+
+    const auto& iterations() const noexcept {
+      return _iterations;
+    }
+
+    auto completed_depth() const noexcept {
+      return _completed_depth;
+    }
+
+    auto best_score() const noexcept {
+      return _best_score;
+    }
+
+    auto time() const noexcept {
+      return _time;
+    }
+
+#ifdef BARYS_SEARCH_TRACE
+    const auto& trace() const noexcept {
+      return _trace;
+    }
+#endif
   };
+
+  using alpha_beta = basic_alpha_beta<barium_rules>;
 }
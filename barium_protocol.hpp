@@ -0,0 +1,367 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <boost/optional.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/range/adaptors.hpp>
+
+#include "game.hpp"
+
+// Bariumサーバーとのメッセージ。bridgeと、bridgeを試すためのbarium-serverで使用します。
+//
+//   サーバーからクライアント: {"lastMove": {"fromBoard": 9, "to": 16}}（相手の手。最初の手番では、lastMoveがありません）
+//   クライアントからサーバー: {"fromCaptured": 0, "to": 23}
+//
+// 盤面は周囲に1マスの枠を付けた7×8の番号で、先手から見た向きです。持ち駒は、手番側の持ち駒を種類の順に並べた時の番号です。
+// turnは何手目か（0から数えます）、stateはその手を指す側から見た局面です。
+//
+// ptreeを使う版はメッセージ毎にstringstreamやノードを確保するので、bridgeでは、バッファーから直接読み書きする版（barium_json_readerと
+// encode_barium_move）を使います。ptreeの版は、barium-serverと、ベンチマークでの比較に使います。
+
+namespace barys {
+  inline auto from_barium_board(int turn, int index) noexcept {
+    const auto& y = index / 7 - 1;
+    const auto& x = index % 7 - 1;
+
+    if (turn % 2 == 0) {
+      return y * 5 + x;
+    } else {
+      return (5 - y) * 5 + (4 - x);
+    }
+  }
+
+  inline auto from_barium_hand(const state& state, int index) noexcept {
+    for (const auto& count: state.piece_counts_in_hand() | boost::adaptors::indexed()) {
+      if (index < count.value()) {
+        return static_cast<int>(count.index());
+      }
+
+      index -= count.value();
+    }
+
+    return -1;
+  }
+
+  inline auto to_barium_board(int turn, int index) noexcept {
+    const auto& y = index / 5;
+    const auto& x = index % 5;
+
+    if (turn % 2 == 0) {
+      return (y + 1) * 7 + (x + 1);
+    } else {
+      return (6 - y) * 7 + (5 - x);
+    }
+  }
+
+  inline auto to_barium_hand(const state& state, int index) noexcept {
+    int result = 0;
+
+    for (const auto& count: state.piece_counts_in_hand() | boost::adaptors::indexed()) {
+      if (count.index() == index) {
+        return result;
+      }
+
+      result += count.value();
+    }
+
+    return result;
+  }
+
+  // 手のオブジェクト（fromBoard、fromCaptured、to）と手の変換。手がない場合は、toが-1になります。
+
+  inline auto from_barium_move(const boost::property_tree::ptree& ptree, int turn, const state& state) {
+    const auto& from_board = ptree.get_optional<int>("fromBoard");
+    const auto& from_hand  = ptree.get_optional<int>("fromCaptured");
+    const auto& to         = ptree.get_optional<int>("to");
+
+    return action(from_board ? from_barium_board(turn, from_board.value()) : -1,
+                  from_hand  ? from_barium_hand(state, from_hand.value())  : -1,
+                  to         ? from_barium_board(turn, to.value())         : -1);
+  }
+
+  inline auto to_barium_move(const action& action, int turn, const state& state) {
+    auto result = boost::property_tree::ptree();
+
+    if (action.from_board() != -1) {
+      result.put<int>("fromBoard", to_barium_board(turn, action.from_board()));
+    }
+
+    if (action.from_hand() != -1) {
+      result.put<int>("fromCaptured", to_barium_hand(state, action.from_hand()));
+    }
+
+    result.put<int>("to", to_barium_board(turn, action.to()));
+
+    return result;
+  }
+
+  inline auto read_barium_json(const std::string& message) {
+    auto stream = std::stringstream(); stream << message;
+    auto result = boost::property_tree::ptree();
+
+    boost::property_tree::read_json(stream, result);
+
+    return result;
+  }
+
+  inline auto write_barium_json(const boost::property_tree::ptree& ptree) {
+    auto stream = std::stringstream();
+
+    boost::property_tree::write_json(stream, ptree);
+
+    return stream.str();
+  }
+
+  // JSONを読む最小限のパーサー。文字列は範囲（開始と終了のポインター）で返して、メモリーを確保しません。形式が正しくない場合は例外を投げます。
+
+  class barium_json_reader final {
+    const char* _it;
+    const char* _end;
+
+    auto skip_whitespace() noexcept {
+      while (_it != _end && (*_it == ' ' || *_it == '\t' || *_it == '\r' || *_it == '\n')) {
+        ++_it;
+      }
+    }
+
+    [[noreturn]] static auto error() {
+      throw std::runtime_error("invalid message");
+    }
+
+  public:
+    barium_json_reader(const char* begin, const char* end) noexcept: _it(begin), _end(end) {
+      ;
+    }
+
+    auto peek() noexcept {
+      skip_whitespace();
+
+      return _it != _end ? *_it : '\0';
+    }
+
+    auto expect(char c) {
+      if (peek() != c) {
+        error();
+      }
+
+      ++_it;
+    }
+
+    auto read_string() {
+      expect('"');
+
+      const auto begin = _it;  // _itは進めるので、コピーしておきます。
+
+      for (; _it != _end && *_it != '"'; ++_it) {
+        if (*_it == '\\' && ++_it == _end) {
+          error();
+        }
+      }
+
+      if (_it == _end) {
+        error();
+      }
+
+      return std::make_pair(begin, _it++);
+    }
+
+    // 整数。ptreeのwrite_jsonは数値も文字列として書くので、"9"のような文字列も整数として読みます。
+
+    auto read_integer() {
+      const auto& is_quoted = peek() == '"';
+
+      if (is_quoted) {
+        ++_it;
+      }
+
+      const auto& is_negative = _it != _end && *_it == '-';
+
+      if (is_negative) {
+        ++_it;
+      }
+
+      if (_it == _end || *_it < '0' || *_it > '9') {
+        error();
+      }
+
+      auto result = 0;
+
+      for (; _it != _end && *_it >= '0' && *_it <= '9'; ++_it) {
+        result = result * 10 + (*_it - '0');
+      }
+
+      if (is_quoted) {
+        expect('"');
+      }
+
+      return is_negative ? -result : result;
+    }
+
+    // オブジェクト。メンバー毎に、キーの範囲を引数にしてfunctionを呼び出します。functionは値を読み飛ばすか、読み込んでください。
+
+    template <typename Function>
+    auto read_object(const Function& function) {
+      expect('{');
+
+      if (peek() == '}') {
+        ++_it;
+        return;
+      }
+
+      for (;;) {
+        const auto& key = read_string();
+
+        expect(':');
+        function(key);
+
+        if (peek() != ',') {
+          break;
+        }
+
+        ++_it;
+      }
+
+      expect('}');
+    }
+
+    auto skip_value() -> void {
+      switch (peek()) {
+      case '{':
+        read_object([&](const auto&) { skip_value(); });
+        break;
+
+      case '[':
+        ++_it;
+
+        if (peek() == ']') {
+          ++_it;
+          break;
+        }
+
+        for (;;) {
+          skip_value();
+
+          if (peek() != ',') {
+            break;
+          }
+
+          ++_it;
+        }
+
+        expect(']');
+        break;
+
+      case '"':
+        read_string();
+        break;
+
+      case '\0':
+        error();
+
+      default:  // 数値、true、false、null。
+        while (_it != _end && *_it != ',' && *_it != '}' && *_it != ']' && *_it != ' ' && *_it != '\t' && *_it != '\r' && *_it != '\n') {
+          ++_it;
+        }
+      }
+    }
+
+    static auto is_key(const std::pair<const char*, const char*>& key, const char* string) noexcept {
+      const auto& size = std::strlen(string);
+
+      return static_cast<std::size_t>(key.second - key.first) == size && std::memcmp(key.first, string, size) == 0;
+    }
+  };
+
+  // 手のオブジェクトを読みます。手がない場合は、toが-1になります。
+
+  inline auto read_barium_move(barium_json_reader& reader, int turn, const state& state) {
+    auto from_board = -1;
+    auto from_hand  = -1;
+    auto to         = -1;
+
+    reader.read_object([&](const auto& key) {
+      if (barium_json_reader::is_key(key, "fromBoard")) {
+        from_board = from_barium_board(turn, reader.read_integer());
+      } else if (barium_json_reader::is_key(key, "fromCaptured")) {
+        from_hand = from_barium_hand(state, reader.read_integer());
+      } else if (barium_json_reader::is_key(key, "to")) {
+        to = from_barium_board(turn, reader.read_integer());
+      } else {
+        reader.skip_value();
+      }
+    });
+
+    return action(from_board, from_hand, to);
+  }
+
+  // サーバーからのメッセージ（lastMoveを含むオブジェクト）を読みます。
+
+  inline auto parse_barium_message(const char* begin, const char* end, int turn, const state& state) {
+    auto reader = barium_json_reader(begin, end);
+    auto result = action(-1, -1, -1);
+
+    reader.read_object([&](const auto& key) {
+      if (barium_json_reader::is_key(key, "lastMove") && reader.peek() == '{') {
+        result = read_barium_move(reader, turn, state);
+      } else {
+        reader.skip_value();
+      }
+    });
+
+    return result;
+  }
+
+  // 手をbufferに書き込んで、書き込んだバイト数を返します。bufferはmax_barium_move_sizeバイト必要です。
+  // 実際のサーバーと確認済みの形式から変えないように、ptreeのwrite_jsonと同じく数値を文字列として書きます。
+
+  static constexpr auto max_barium_move_size = std::size_t(64);
+
+  inline auto encode_barium_move(const action& action, int turn, const state& state, char* buffer) noexcept {
+    auto it = buffer;
+
+    const auto& append = [&](const char* string) {
+      const auto& size = std::strlen(string);
+
+      std::memcpy(it, string, size);
+      it += size;
+    };
+
+    const auto& append_integer = [&](int value) {
+      *it++ = '"';
+
+      if (value >= 10) {
+        *it++ = static_cast<char>('0' + value / 10);
+      }
+
+      *it++ = static_cast<char>('0' + value % 10);
+      *it++ = '"';
+    };
+
+    append("{");
+
+    if (action.from_board() != -1) {
+      append("\"fromBoard\":");
+      append_integer(to_barium_board(turn, action.from_board()));
+      append(",");
+    }
+
+    if (action.from_hand() != -1) {
+      append("\"fromCaptured\":");
+      append_integer(to_barium_hand(state, action.from_hand()));
+      append(",");
+    }
+
+    append("\"to\":");
+    append_integer(to_barium_board(turn, action.to()));
+    append("}");
+
+    return static_cast<std::size_t>(it - buffer);
+  }
+}
@@ -0,0 +1,249 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+#include <boost/range/algorithm.hpp>
+
+#include "alpha_beta.hpp"
+#include "barium_protocol.hpp"
+#include "game.hpp"
+#include "search_control.hpp"
+#include "transposition_table.hpp"
+
+// Bariumサーバーの代わり。bridgeと同じJSONのメッセージで対局して、bridgeが手を返すまでの時間を測ります。
+//
+// サーバー側の手は、最初のrandom_plies手はランダムに、その後は探索で決めます。乱数の種を指定するので、同じ対局を繰り返せます。
+// 1つの接続で1局対局して、終わったら接続を閉じます。bridgeは1局毎に終了するので、gamesを指定した場合はbridgeを起動し直してください。
+// concurrencyを指定すると、その数の接続を受け付けてから、それぞれの対局をスレッドで同時に進めます（bridgeの--gamesを試すためのものです）。
+
+namespace {
+  struct game_result final {
+    int client_result;  // クライアントから見た結果。勝ちが1、引き分けが0、負けが-1です。
+    int ply_count;
+    std::vector<double> latencies;  // クライアントの手毎の、メッセージを書き込んでから手を読み込むまでの時間（ミリ秒）。
+    bool is_illegal;
+  };
+
+  auto play(boost::asio::ip::tcp::socket socket, int client_side, int random_plies, std::mt19937& random_engine, int opponent_time_in_ms, int opponent_depth, barys::transposition_table& transposition_table, int max_plies) {
+    auto result = game_result{0, 0, {}, false};
+
+    auto websocket_stream = boost::beast::websocket::stream<boost::asio::ip::tcp::socket>(std::move(socket));
+    websocket_stream.accept();
+
+    transposition_table.clear();
+
+    auto state          = barys::state();
+    auto previous_state = barys::state();
+    auto last_action    = boost::optional<barys::action>();
+    auto repetitions    = std::map<std::pair<std::uint64_t, int>, int>();
+
+    for (auto turn = 0; turn < max_plies; ++turn) {
+      if (++repetitions[std::make_pair(state.hash(), turn % 2)] >= 3) {
+        break;
+      }
+
+      auto action = barys::action();
+
+      if (turn % 2 == client_side) {
+        auto message = boost::property_tree::ptree();
+
+        if (last_action) {
+          message.add_child("lastMove", barys::to_barium_move(*last_action, turn - 1, previous_state));
+        }
+
+        auto buffer = boost::beast::flat_buffer();
+
+        const auto& starting_time = std::chrono::steady_clock::now();
+
+        websocket_stream.write(boost::asio::buffer(barys::write_barium_json(message)));
+        websocket_stream.read(buffer);
+
+        result.latencies.emplace_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - starting_time).count());
+
+        action = barys::from_barium_move(barys::read_barium_json(boost::beast::buffers_to_string(buffer.data())), turn, state);
+
+        const auto& actions = state.actions();
+
+        if (boost::find(actions, action) == std::end(actions)) {  // 合法手ではない手を指したら、クライアントの負けです。
+          result.client_result = -1;
+          result.is_illegal    = true;
+
+          break;
+        }
+
+      } else if (turn < random_plies) {
+        const auto& actions = state.actions();
+
+        action = actions[random_engine() % actions.size()];
+
+      } else {
+        auto search_control = barys::search_control(opponent_time_in_ms > 0 ? std::chrono::steady_clock::now() + std::chrono::milliseconds(opponent_time_in_ms) : std::chrono::steady_clock::time_point::max());
+
+        action = barys::alpha_beta(state, search_control, transposition_table, 1, opponent_depth)();
+      }
+
+      previous_state = state;
+      state          = state.next(action);
+      last_action    = action;
+
+      result.ply_count = turn + 1;
+
+      if (state.is_end()) {  // 相手のライオンを取ったので、指した側の勝ちです。
+        result.client_result = turn % 2 == client_side ? 1 : -1;
+
+        break;
+      }
+    }
+
+    websocket_stream.close(boost::beast::websocket::close_code::normal);
+
+    return result;
+  }
+
+  auto percentile(const std::vector<double>& sorted_values, double rate) noexcept {
+    return sorted_values.empty() ? 0.0 : sorted_values[std::min(static_cast<std::size_t>(rate * sorted_values.size()), sorted_values.size() - 1)];
+  }
+}
+
+int main(int argc, char** argv) {
+  auto options = boost::program_options::options_description("options");
+  options.add_options()
+    ("help", "print this message")
+    ("port", boost::program_options::value<unsigned short>()->default_value(8080), "port to listen on")
+    ("games", boost::program_options::value<int>()->default_value(1), "number of games (one connection per game)")
+    ("concurrency", boost::program_options::value<int>()->default_value(1), "number of games played at the same time")
+    ("client-side", boost::program_options::value<std::string>()->default_value("alternate"), "side of the client (first, second or alternate)")
+    ("random-plies", boost::program_options::value<int>()->default_value(4), "random plies of the server at the start of each game")
+    ("seed", boost::program_options::value<std::uint32_t>()->default_value(0), "random seed for the random plies")
+    ("time", boost::program_options::value<int>()->default_value(100), "search time of the server per move in milliseconds (0 searches to --depth)")
+    ("depth", boost::program_options::value<int>()->default_value(barys::alpha_beta::max_depth), "search depth limit of the server")
+    ("hash", boost::program_options::value<std::size_t>()->default_value(16), "transposition table size of the server in MB")
+    ("max-plies", boost::program_options::value<int>()->default_value(256), "adjudicate the game as a draw after this many plies")
+    ("budget", boost::program_options::value<int>()->default_value(15000), "time allowed for a client move in milliseconds");
+
+  auto variables = boost::program_options::variables_map();
+
+  try {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), variables);
+    boost::program_options::notify(variables);
+
+  } catch (const boost::program_options::error& e) {
+    std::cerr << e.what() << std::endl << options << std::endl;
+
+    return 1;
+  }
+
+  if (variables.count("help")) {
+    std::cout << options << std::endl;
+
+    return 0;
+  }
+
+  try {
+    const auto& client_side = variables["client-side"].as<std::string>();
+
+    if (client_side != "first" && client_side != "second" && client_side != "alternate") {
+      throw std::runtime_error("unknown client side: " + client_side);
+    }
+
+    const auto game_count  = std::max(variables["games"].as<int>(), 1);
+    const auto concurrency = std::max(variables["concurrency"].as<int>(), 1);
+    const auto budget      = variables["budget"].as<int>();
+
+    auto io_context    = boost::asio::io_context();
+    auto acceptor      = boost::asio::ip::tcp::acceptor(io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), variables["port"].as<unsigned short>()));
+    auto random_engine = std::mt19937(variables["seed"].as<std::uint32_t>());
+
+    auto transposition_tables = std::vector<std::unique_ptr<barys::transposition_table>>();  // 同時に進める対局毎に1つです。
+
+    for (auto i = 0; i < concurrency; ++i) {
+      transposition_tables.emplace_back(std::make_unique<barys::transposition_table>(variables["hash"].as<std::size_t>()));
+    }
+
+    auto results   = std::array<int, 3>{};  // クライアントの負け、引き分け、勝ちの数。
+    auto latencies = std::vector<double>();
+
+    std::cout << "listening on port " << variables["port"].as<unsigned short>() << std::endl;
+
+    for (auto i = 0; i < game_count; i += concurrency) {
+      const auto batch_size = std::min(concurrency, game_count - i);
+
+      auto sides          = std::vector<int>();
+      auto random_engines = std::vector<std::mt19937>();  // 同時に進める対局でも、乱数の種が同じなら同じ対局になるように、対局毎に乱数を分けます。
+      auto batch_results  = std::vector<game_result>(batch_size);
+      auto exceptions     = std::vector<std::exception_ptr>(batch_size);
+      auto threads        = std::vector<std::thread>();
+
+      for (auto j = 0; j < batch_size; ++j) {
+        sides.emplace_back(client_side == "first" ? 0 : client_side == "second" ? 1 : (i + j) % 2);
+        random_engines.emplace_back(random_engine());
+      }
+
+      for (auto j = 0; j < batch_size; ++j) {
+        auto socket = boost::asio::ip::tcp::socket(acceptor.get_executor());
+        acceptor.accept(socket);
+
+        const auto& game = [&, j](boost::asio::ip::tcp::socket& socket) {
+          try {
+            batch_results[j] = play(std::move(socket), sides[j], variables["random-plies"].as<int>(), random_engines[j], variables["time"].as<int>(), variables["depth"].as<int>(), *transposition_tables[j], std::max(variables["max-plies"].as<int>(), 1));
+
+          } catch (...) {
+            exceptions[j] = std::current_exception();
+          }
+        };
+
+        if (batch_size == 1) {
+          game(socket);
+        } else {
+          threads.emplace_back([&, game, socket = std::move(socket)]() mutable { game(socket); });
+        }
+      }
+
+      for (auto& thread: threads) {
+        thread.join();
+      }
+
+      for (auto j = 0; j < batch_size; ++j) {
+        if (exceptions[j]) {
+          std::rethrow_exception(exceptions[j]);
+        }
+
+        const auto& result = batch_results[j];
+
+        results[result.client_result + 1]++;
+        latencies.insert(std::end(latencies), std::begin(result.latencies), std::end(result.latencies));
+
+        const auto& late_count = boost::count_if(result.latencies, [&](const auto& latency) { return latency > budget; });
+
+        std::cout << "game " << i + j + 1 << " / " << game_count << ": client " << (sides[j] == 0 ? "first" : "second") << ", " << (result.client_result == 1 ? "client wins" : result.client_result == -1 ? "server wins" : "draw") << (result.is_illegal ? " (illegal move)" : "") << " in " << result.ply_count << " plies, late moves = " << late_count << std::endl;
+      }
+    }
+
+    boost::sort(latencies);
+
+    std::cout << "client wins - draws - server wins: " << results[2] << " - " << results[1] << " - " << results[0] << std::endl;
+    std::cout << "client move latency (ms): moves = " << latencies.size() << std::fixed << std::setprecision(1) << ", p50 = " << percentile(latencies, 0.5) << ", p90 = " << percentile(latencies, 0.9) << ", p99 = " << percentile(latencies, 0.99) << ", max = " << (latencies.empty() ? 0.0 : latencies.back()) << ", over " << budget << " ms = " << boost::count_if(latencies, [&](const auto& latency) { return latency > budget; }) << std::endl;
+
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+
+    return 1;
+  }
+
+  return 0;
+}
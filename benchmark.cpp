@@ -0,0 +1,846 @@
+﻿#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include <nmmintrin.h>
+
+#include "alpha_beta.hpp"
+#include "barium_protocol.hpp"
+#include "evaluation.hpp"
+#include "evaluation_batch.hpp"
+#include "evaluation_weights.hpp"
+#include "game.hpp"
+#include "mate_solver.hpp"
+#include "move.hpp"
+#include "notation.hpp"
+#include "position.hpp"
+#include "search_control.hpp"
+#include "tablebase.hpp"
+#include "transposition_table.hpp"
+
+namespace {
+  const auto default_positions = std::vector<std::string>{"cdldc/...../.hhh./.HHH./...../CDLDC -",
+                                                          "c.ldc/..d../.H..H/..hh./...../CDLDC hh",
+                                                          "...dc/cl.../..d.H/..hh./.L..C/CD.D. hhh",
+                                                          "..d.c/.l.../..d.H/.chhC/n..../DCLD. hh",
+                                                          "..d.c/.l.../..d.H/..Hhd/D.L../..... HCChhc"};
+
+  // --variant dobutsuの場合の局面。トライのないどうぶつしょうぎ（3×4）で、駒はH（ひよこ）、G（きりん）、E（ぞう）、L（ライオン）、N（にわとり）です。
+
+  const auto default_dobutsu_positions = std::vector<std::string>{"gle/.h./.H./ELG -",
+                                                                  "gl./.e./.H./ELG H",
+                                                                  "..l/gE./.Nh/.L. eg"};
+
+  auto read_positions(const std::string& path) {
+    auto result = std::vector<std::string>();
+
+    auto stream = std::ifstream(path);
+
+    if (!stream) {
+      throw std::runtime_error("cannot open " + path);
+    }
+
+    for (auto line = std::string(); std::getline(stream, line);) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+
+      if (line.empty() || line.front() == '#') {
+        continue;
+      }
+
+      result.emplace_back(line);
+    }
+
+    return result;
+  }
+
+  auto elapsed_seconds(const std::chrono::steady_clock::time_point& starting_time) noexcept {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - starting_time).count();
+  }
+
+  auto nodes_per_second(std::uint64_t node_count, double time) noexcept {
+    return time > 0 ? node_count / time : 0.0;
+  }
+
+  // perft。指定した深さの末端局面の数を数えて、合法手生成と局面の更新の速度を測ります。ライオンを取られた局面は末端として扱います。
+  // nextやmakeの速度も測りたいので、最後の深さでも手の数を数えるだけで済ませずに局面を更新します。
+
+  template <typename Rules>
+  std::uint64_t perft(const barys::basic_state<Rules>& state, int depth) noexcept {
+    if (depth == 0) {
+      return 1;
+    }
+
+    if (state.is_end()) {
+      return 0;
+    }
+
+    auto result = std::uint64_t(0);
+
+    for (const auto& action: state.actions()) {
+      result += perft(state.next(action), depth - 1);
+    }
+
+    return result;
+  }
+
+  template <typename Rules>
+  std::uint64_t perft(barys::basic_position<Rules>& position, barys::basic_move_stack<Rules>& move_stack, int depth) noexcept {
+    if (depth == 0) {
+      return 1;
+    }
+
+    if (position.is_end()) {
+      return 0;
+    }
+
+    auto result = std::uint64_t(0);
+
+    const auto& moves = barys::basic_move_list<Rules>(move_stack, [&](auto result) { return position.generate_moves(result); });
+
+    for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+      const auto& undo = position.make(moves[i]);
+
+      result += perft(position, move_stack, depth - 1);
+
+      position.unmake(undo);
+    }
+
+    return result;
+  }
+
+  // stateのnextとpositionのmake/unmakeの両方でperftして、速度を比較します。結果が一致しない場合は例外を投げます。
+  // Rulesを変えれば、ルール毎に生成した合法手生成の速度を測れます。
+
+  template <typename Rules>
+  auto perft(const std::vector<std::string>& positions, int depth, bool is_json) {
+    if (is_json) {
+      std::cout << "{\"benchmark\": \"perft\", \"positions\": [";
+    }
+
+    auto total_node_count = std::uint64_t(0);
+    auto total_time       = 0.0;
+    auto total_make_time  = 0.0;
+
+    for (const auto& position: positions) {
+      const auto& state = barys::to_state<Rules>(position);
+
+      auto made_position = barys::basic_position<Rules>(state);
+      auto move_stack    = barys::basic_move_stack<Rules>();
+
+      if (is_json) {
+        std::cout << (&position == &positions.front() ? "" : ", ") << "{\"position\": \"" << position << "\", \"depths\": [";
+      } else {
+        std::cout << position << std::endl << "  depth            nodes      time [s]       nodes/s   branching   make [s]  make nodes/s   speedup" << std::endl;
+      }
+
+      auto previous_node_count = std::uint64_t(1);
+
+      for (auto i = 1; i <= depth; ++i) {
+        const auto& starting_time = std::chrono::steady_clock::now();
+        const auto& node_count    = perft(state, i);
+        const auto& time          = elapsed_seconds(starting_time);
+
+        const auto& make_starting_time = std::chrono::steady_clock::now();
+        const auto& make_node_count    = perft(made_position, move_stack, i);
+        const auto& make_time          = elapsed_seconds(make_starting_time);
+
+        if (make_node_count != node_count) {
+          throw std::runtime_error("perft mismatch at depth " + std::to_string(i) + " in \"" + position + "\": next " + std::to_string(node_count) + ", make " + std::to_string(make_node_count));
+        }
+
+        const auto& branching_factor = previous_node_count ? static_cast<double>(node_count) / previous_node_count : 0.0;
+        const auto& speedup          = make_time > 0 ? time / make_time : 0.0;
+
+        if (is_json) {
+          std::cout << (i == 1 ? "" : ", ") << "{\"depth\": " << i << ", \"nodes\": " << node_count << ", \"time\": " << time << ", \"nps\": " << nodes_per_second(node_count, time) << ", \"branching_factor\": " << branching_factor << ", \"make_time\": " << make_time << ", \"make_nps\": " << nodes_per_second(node_count, make_time) << ", \"speedup\": " << speedup << "}";
+        } else {
+          std::cout << std::setw(7) << i << std::setw(17) << node_count << std::fixed << std::setprecision(3) << std::setw(14) << time << std::setprecision(0) << std::setw(14) << nodes_per_second(node_count, time) << std::setprecision(2) << std::setw(12) << branching_factor << std::setprecision(3) << std::setw(11) << make_time << std::setprecision(0) << std::setw(14) << nodes_per_second(node_count, make_time) << std::setprecision(2) << std::setw(10) << speedup << std::defaultfloat << std::endl;
+        }
+
+        previous_node_count = node_count;
+
+        total_node_count += node_count;
+        total_time       += time;
+        total_make_time  += make_time;
+      }
+
+      if (is_json) {
+        std::cout << "]}";
+      }
+    }
+
+    if (is_json) {
+      std::cout << "], \"nodes\": " << total_node_count << ", \"time\": " << total_time << ", \"nps\": " << nodes_per_second(total_node_count, total_time) << ", \"make_time\": " << total_make_time << ", \"make_nps\": " << nodes_per_second(total_node_count, total_make_time) << ", \"speedup\": " << (total_make_time > 0 ? total_time / total_make_time : 0.0) << "}" << std::endl;
+    } else {
+      std::cout << "total: " << total_node_count << " nodes, " << std::fixed << std::setprecision(3) << total_time << " s, " << std::setprecision(0) << nodes_per_second(total_node_count, total_time) << " nodes/s, make: " << std::setprecision(3) << total_make_time << " s, " << std::setprecision(0) << nodes_per_second(total_node_count, total_make_time) << " nodes/s, speedup " << std::setprecision(2) << (total_make_time > 0 ? total_time / total_make_time : 0.0) << std::defaultfloat << std::endl;
+    }
+  }
+
+  // 固定深さの探索。反復深化の各深さの時間とノード数を出力します。nodes/sは、静止探索のノードも含めて計算します。
+  // timeを指定した場合は、固定時間で探索して到達した深さを比べます。
+
+  template <typename Rules>
+  auto search(const std::vector<std::string>& positions, int depth, int time_in_ms, std::size_t transposition_table_size, int thread_count, const barys::search_options& options, bool is_json) {
+    auto transposition_table = barys::transposition_table(transposition_table_size);
+
+    if (is_json) {
+      std::cout << "{\"benchmark\": \"search\", \"threads\": " << thread_count << ", \"positions\": [";
+    }
+
+    auto total_node_count            = std::uint64_t(0);
+    auto total_quiescence_node_count = std::uint64_t(0);
+    auto total_time                  = 0.0;
+
+    for (const auto& position: positions) {
+      const auto& state = barys::to_state<Rules>(position);
+
+      transposition_table.clear();
+
+      const auto& starting_time = std::chrono::steady_clock::now();
+
+      auto search_control = barys::search_control(time_in_ms ? starting_time + std::chrono::milliseconds(time_in_ms) : std::chrono::steady_clock::time_point::max());
+
+      auto search = barys::basic_alpha_beta<Rules>(state, search_control, transposition_table, thread_count, time_in_ms ? barys::alpha_beta::max_depth : depth, options);
+      const auto& action = search();
+
+      const auto& time = elapsed_seconds(starting_time);
+
+      const auto& all_node_count = search.node_count() + search.quiescence_node_count();
+
+      if (is_json) {
+        std::cout << (&position == &positions.front() ? "" : ", ") << "{\"position\": \"" << position << "\", \"action\": [" << action.from_board() << ", " << action.from_hand() << ", " << action.to() << "], \"score\": " << search.best_score() << ", \"depth\": " << search.completed_depth() << ", \"nodes\": " << search.node_count() << ", \"qnodes\": " << search.quiescence_node_count() << ", \"time\": " << time << ", \"nps\": " << nodes_per_second(all_node_count, time) << ", \"checks\": " << search.check_count() << ", \"check_overhead\": " << search.check_overhead() << ", \"null_moves\": " << search.null_move_count() << ", \"null_move_cutoff_rate\": " << search.null_move_cutoff_rate() << ", \"reductions\": " << search.reduction_count() << ", \"reduction_researches\": " << search.reduction_research_count() << ", \"pvs_researches\": " << search.principal_variation_research_count() << ", \"aspiration_researches\": " << search.aspiration_research_count() << ", \"iterations\": [";
+      } else {
+        std::cout << position << std::endl << "  depth     score            nodes           qnodes      time [s]   branching" << std::endl;
+      }
+
+      // 深さ1では根の子がすべて静止探索になってnodesが0になるので、分岐因子はnodesとqnodesの合計から求めます。深さ0は根の1ノードとします。
+
+      auto previous_all_node_count = std::uint64_t(1);
+
+      for (const auto& iteration: search.iterations()) {
+        const auto& iteration_time           = std::chrono::duration<double>(iteration.time).count();
+        const auto& iteration_all_node_count = iteration.node_count + iteration.quiescence_node_count;
+        const auto& branching_factor         = static_cast<double>(iteration_all_node_count) / previous_all_node_count;
+
+        if (is_json) {
+          std::cout << (&iteration == &search.iterations().front() ? "" : ", ") << "{\"depth\": " << iteration.depth << ", \"score\": " << iteration.score << ", \"nodes\": " << iteration.node_count << ", \"qnodes\": " << iteration.quiescence_node_count << ", \"time\": " << iteration_time << ", \"branching_factor\": " << branching_factor << "}";
+        } else {
+          std::cout << std::setw(7) << iteration.depth << std::setw(10) << iteration.score << std::setw(17) << iteration.node_count << std::setw(17) << iteration.quiescence_node_count << std::fixed << std::setprecision(3) << std::setw(14) << iteration_time << std::setprecision(2) << std::setw(12) << branching_factor << std::defaultfloat << std::endl;
+        }
+
+        previous_all_node_count = iteration_all_node_count;
+      }
+
+      if (is_json) {
+        std::cout << "]}";
+      } else {
+        std::cout << "  action = (" << action.from_board() << ", " << action.from_hand() << ", " << action.to() << "), nodes = " << search.node_count() << ", qnodes = " << search.quiescence_node_count() << ", " << std::fixed << std::setprecision(0) << nodes_per_second(all_node_count, time) << " nodes/s, checks = " << search.check_count() << ", check overhead = " << std::setprecision(4) << search.check_overhead() * 100 << " %" << std::defaultfloat << std::endl;
+        std::cout << "  null moves = " << search.null_move_count() << " (cutoff rate " << search.null_move_cutoff_rate() << "), reductions = " << search.reduction_count() << " (re-searched " << search.reduction_research_count() << "), pvs re-searches = " << search.principal_variation_research_count() << ", aspiration re-searches = " << search.aspiration_research_count() << std::endl;
+      }
+
+      total_node_count            += search.node_count();
+      total_quiescence_node_count += search.quiescence_node_count();
+      total_time                  += time;
+    }
+
+    if (is_json) {
+      std::cout << "], \"nodes\": " << total_node_count << ", \"qnodes\": " << total_quiescence_node_count << ", \"time\": " << total_time << ", \"nps\": " << nodes_per_second(total_node_count + total_quiescence_node_count, total_time) << "}" << std::endl;
+    } else {
+      std::cout << "total: " << total_node_count << " nodes, " << total_quiescence_node_count << " qnodes, " << std::fixed << std::setprecision(3) << total_time << " s, " << std::setprecision(0) << nodes_per_second(total_node_count + total_quiescence_node_count, total_time) << " nodes/s" << std::defaultfloat << std::endl;
+    }
+  }
+
+  // 駒の点数だけの、以前の評価関数。評価関数の速度の比較に使用します。
+
+  auto material_only_score(const barys::position& position) noexcept {
+    static constexpr int piece_scores[6] = {100, 1000, 1200, 0, 1200, 1200};  // ひよこ、ねこ、いぬ、ライオン、にわとり、パワーアップねこ。
+
+    const auto& side = position.side();
+
+    auto result = 0;
+
+    for (auto i = 0; i < 6; ++i) {
+      result += (static_cast<int>(_mm_popcnt_u32(position.pieces_on_board(side)[i])) - static_cast<int>(_mm_popcnt_u32(position.pieces_on_board(side ^ 1)[i]))) * piece_scores[i];
+    }
+
+    for (auto i = 0; i < 3; ++i) {
+      result += (position.piece_counts_in_hand(side)[i] - position.piece_counts_in_hand(side ^ 1)[i]) * piece_scores[i];
+    }
+
+    return result;
+  }
+
+  // 駒とマス目の点数を差分計算せずに、毎回計算する評価関数。差分計算の効果を測るために使用します。
+
+  auto recomputed_evaluate(const barys::position& position) noexcept {
+    const auto& side = position.side();
+
+    const auto& piece_square_score = [&](int side) {
+      auto result = 0;
+
+      for (auto i = 0; i < 6; ++i) {
+        for (auto piece_bits = position.pieces_on_board(side)[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          const auto& bit = static_cast<int>(_tzcnt_u32(piece_bits));
+
+          result += position.weights().piece_square[i][side ? 29 - bit : bit];
+        }
+      }
+
+      return result;
+    };
+
+    return barys::evaluate(position) - (position.piece_square_score(side) - position.piece_square_score(side ^ 1)) + (piece_square_score(side) - piece_square_score(side ^ 1));
+  }
+
+  // 指定した深さまで局面を進めて、末端局面でevaluateを呼び出します。呼び出した回数を返します。
+
+  template <typename Evaluate>
+  std::uint64_t evaluation_walk(barys::position& position, barys::move_stack& move_stack, int depth, const Evaluate& evaluate, int& score_sum) noexcept {
+    if (depth == 0) {
+      score_sum += evaluate(position);  // 最適化で消されないように、結果を使います。
+
+      return 1;
+    }
+
+    if (position.is_end()) {
+      return 0;
+    }
+
+    auto result = std::uint64_t(0);
+
+    const auto& moves = barys::move_list(move_stack, [&](auto result) { return position.generate_moves(result); });
+
+    for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+      const auto& undo = position.make(moves[i]);
+
+      result += evaluation_walk(position, move_stack, depth - 1, evaluate, score_sum);
+
+      position.unmake(undo);
+    }
+
+    return result;
+  }
+
+  // evaluation_walkの一括評価版。深さ1の局面で、子の局面をまとめて評価します。
+
+  std::uint64_t batch_evaluation_walk(barys::position& position, barys::move_stack& move_stack, barys::evaluation_batch& evaluation_batch, int depth, int& score_sum) noexcept {
+    if (position.is_end()) {
+      return 0;
+    }
+
+    auto result = std::uint64_t(0);
+
+    const auto& moves = barys::move_list(move_stack, [&](auto result) { return position.generate_moves(result); });
+
+    if (depth == 1) {
+      evaluation_batch.clear();
+
+      for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+        const auto& undo = position.make(moves[i]);
+
+        evaluation_batch.add(position, moves[i], std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+
+        position.unmake(undo);
+      }
+
+      evaluation_batch.evaluate(position.weights());
+
+      for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+        score_sum += evaluation_batch.score(moves[i]);
+      }
+
+      return moves.size();
+    }
+
+    for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+      const auto& undo = position.make(moves[i]);
+
+      result += batch_evaluation_walk(position, move_stack, evaluation_batch, depth - 1, score_sum);
+
+      position.unmake(undo);
+    }
+
+    return result;
+  }
+
+  // 評価関数1回あたりの時間。評価関数を呼ばずに局面を進めるだけの時間を引いて計算します。
+  // makeでの差分計算の時間は局面を進める時間に入るので、それも別に出力します。一括評価は、深さ1の局面で子の局面をまとめて評価した場合の時間です。
+
+  auto evaluation(const std::vector<std::string>& positions, int depth, bool is_json) {
+    auto evaluation_count      = std::uint64_t(0);
+    auto walk_time             = 0.0;
+    auto material_time         = 0.0;
+    auto recomputed_time       = 0.0;
+    auto incremental_time      = 0.0;
+    auto batch_time            = 0.0;
+    auto score_sum             = 0;
+    auto incremental_score_sum = 0;  // 一括評価の結果がevaluateと一致することを確かめるために、別に合計します。
+    auto batch_score_sum       = 0;
+
+    auto evaluation_batch = barys::evaluation_batch();
+
+    for (const auto& position_string: positions) {
+      auto position   = barys::position(barys::to_state(position_string));
+      auto move_stack = barys::move_stack();
+
+      const auto& time = [&](const auto& evaluate) {
+        const auto& starting_time = std::chrono::steady_clock::now();
+
+        evaluation_count += evaluation_walk(position, move_stack, depth, evaluate, score_sum);
+
+        return elapsed_seconds(starting_time);
+      };
+
+      walk_time        += time([](const auto&) { return 0; });
+      material_time    += time([](const auto& position) { return material_only_score(position); });
+      recomputed_time  += time([](const auto& position) { return recomputed_evaluate(position); });
+      incremental_time += time([&](const auto& position) { const auto& result = barys::evaluate(position); incremental_score_sum += result; return result; });
+
+      if (depth > 0) {
+        const auto& starting_time = std::chrono::steady_clock::now();
+
+        batch_evaluation_walk(position, move_stack, evaluation_batch, depth, batch_score_sum);
+
+        batch_time += elapsed_seconds(starting_time);
+      }
+    }
+
+    evaluation_count /= 4;
+
+    const auto& nanoseconds = [&](double time) {
+      return evaluation_count ? std::max(time - walk_time, 0.0) / evaluation_count * 1e9 : 0.0;
+    };
+
+    if (is_json) {
+      std::cout << "{\"benchmark\": \"eval\", \"depth\": " << depth << ", \"evaluations\": " << evaluation_count << ", \"walk_ns\": " << (evaluation_count ? walk_time / evaluation_count * 1e9 : 0.0) << ", \"material_ns\": " << nanoseconds(material_time) << ", \"recomputed_ns\": " << nanoseconds(recomputed_time) << ", \"incremental_ns\": " << nanoseconds(incremental_time) << ", \"batch_ns\": " << nanoseconds(batch_time) << ", \"batch_matches\": " << (batch_score_sum == incremental_score_sum ? "true" : "false") << ", \"checksum\": " << score_sum << "}" << std::endl;
+    } else {
+      std::cout << "evaluations: " << evaluation_count << ", walk (make/unmake and move generation): " << std::fixed << std::setprecision(2) << (evaluation_count ? walk_time / evaluation_count * 1e9 : 0.0) << " ns/node" << std::endl;
+      std::cout << "  material only:           " << std::setw(8) << nanoseconds(material_time)    << " ns/eval" << std::endl;
+      std::cout << "  positional, recomputed:  " << std::setw(8) << nanoseconds(recomputed_time)  << " ns/eval" << std::endl;
+      std::cout << "  positional, incremental: " << std::setw(8) << nanoseconds(incremental_time) << " ns/eval" << " (checksum " << score_sum << ")" << std::endl;
+      std::cout << "  positional, batched:     " << std::setw(8) << nanoseconds(batch_time)       << " ns/eval" << std::defaultfloat << " (" << (batch_score_sum == incremental_score_sum ? "matches evaluate" : "DOES NOT match evaluate") << ")" << std::endl;
+    }
+  }
+
+  // 終盤データベースを引く時間。読み込んだファイル毎に、ありえる局面をランダムに選んで引きます。
+  // 番号の計算だけの時間と、メモリーを読む時間を含めた時間を出力します。初めて読むページは遅いので、全体を一度読んでから測ります。
+
+  auto tablebase(int probe_count, bool is_json) {
+    const auto& tablebases = barys::current_tablebases();
+
+    if (tablebases.size() == 0) {
+      throw std::runtime_error("no tablebases loaded (use --tablebases)");
+    }
+
+    if (is_json) {
+      std::cout << "{\"benchmark\": \"tablebase\", \"tablebases\": [";
+    } else {
+      std::cout << "name            positions    valid [%]   index [ns]   probe [ns]" << std::endl;
+    }
+
+    auto random_engine = std::mt19937_64(0);
+    auto is_first      = true;
+
+    for (auto i = 0; i < 4 * 4 * 4; ++i) {
+      const auto& signature = barys::tablebase::signature{i % 4, i / 4 % 4, i / 16};
+
+      const auto& table = tablebases.find(signature);
+
+      if (!table) {
+        continue;
+      }
+
+      auto valid_count = std::uint64_t(0);
+      auto checksum    = 0;
+
+      for (auto index = std::uint64_t(0); index < table->size(); ++index) {
+        checksum += table->value(index);
+
+        if (barys::tablebase::to_tablebase_position(signature, index)) {
+          valid_count++;
+        }
+      }
+
+      auto positions = std::vector<barys::position>();
+
+      while (static_cast<int>(positions.size()) < probe_count) {
+        const auto& position = barys::tablebase::to_tablebase_position(signature, random_engine() % table->size());
+
+        if (position) {
+          positions.emplace_back(barys::tablebase::to_state(*position));
+        }
+      }
+
+      auto starting_time = std::chrono::steady_clock::now();
+
+      for (const auto& position: positions) {
+        checksum += static_cast<int>(barys::tablebase::index(barys::tablebase::to_tablebase_position(position)) & 1);
+      }
+
+      const auto& index_time = elapsed_seconds(starting_time);
+
+      starting_time = std::chrono::steady_clock::now();
+
+      for (const auto& position: positions) {
+        checksum += table->probe(position);
+      }
+
+      const auto& probe_time = elapsed_seconds(starting_time);
+
+      const auto& valid_rate = 100.0 * valid_count / table->size();
+
+      if (is_json) {
+        std::cout << (is_first ? "" : ", ") << "{\"name\": \"" << barys::tablebase::name(signature) << "\", \"positions\": " << table->size() << ", \"valid\": " << valid_count << ", \"index_ns\": " << index_time / probe_count * 1e9 << ", \"probe_ns\": " << probe_time / probe_count * 1e9 << ", \"checksum\": " << checksum << "}";
+      } else {
+        std::cout << std::left << std::setw(10) << barys::tablebase::name(signature) << std::right << std::setw(15) << table->size() << std::fixed << std::setprecision(1) << std::setw(13) << valid_rate << std::setprecision(2) << std::setw(13) << index_time / probe_count * 1e9 << std::setw(13) << probe_time / probe_count * 1e9 << std::defaultfloat << " (checksum " << checksum << ")" << std::endl;
+      }
+
+      is_first = false;
+    }
+
+    if (is_json) {
+      std::cout << "]}" << std::endl;
+    }
+  }
+
+  // ランダムに指し進めた局面。詰み探索のベンチマークで使用します。乱数の種は固定なので、毎回同じ局面になります。
+
+  auto random_positions(int count) {
+    auto result = std::vector<std::string>();
+
+    auto random_engine = std::mt19937(0);
+
+    while (static_cast<int>(result.size()) < count) {
+      auto state = barys::state();
+
+      for (auto ply = std::uniform_int_distribution<int>(10, 80)(random_engine); ply > 0 && !state.is_end(); --ply) {
+        const auto& actions = state.actions();
+
+        state = state.next(actions[random_engine() % actions.size()]);
+      }
+
+      if (!state.is_end()) {
+        result.emplace_back(barys::to_string(state));
+      }
+    }
+
+    return result;
+  }
+
+  // 詰み探索。1局面あたりtime_in_msミリ秒で解いて、解けた詰みの数と1秒あたりの数、詰み手順の長さの分布を出力します。
+
+  auto mate(const std::vector<std::string>& positions, int time_in_ms, std::size_t table_size, bool is_json) {
+    auto solver = barys::mate_solver(table_size);
+
+    auto mate_count       = 0;
+    auto timeout_count    = 0;
+    auto total_node_count = std::uint64_t(0);
+    auto total_time       = 0.0;
+    auto lengths          = std::map<int, int>();  // 詰み手順の長さ毎の、詰みの数。
+
+    for (const auto& position: positions) {
+      const auto& state = barys::to_state(position);
+
+      const auto& starting_time = std::chrono::steady_clock::now();
+
+      auto search_control = barys::search_control(starting_time + std::chrono::milliseconds(time_in_ms));
+
+      const auto& action = solver(state, search_control);
+
+      total_time       += elapsed_seconds(starting_time);
+      total_node_count += solver.node_count();
+
+      if (action) {
+        mate_count++;
+        lengths[solver.mate_length()]++;
+      }
+
+      if (solver.is_timeout()) {
+        timeout_count++;
+      }
+    }
+
+    const auto& mates_per_second = total_time > 0 ? mate_count / total_time : 0.0;
+    const auto& max_length       = lengths.empty() ? 0 : lengths.rbegin()->first;
+
+    if (is_json) {
+      std::cout << "{\"benchmark\": \"mate\", \"positions\": " << positions.size() << ", \"time_per_position\": " << time_in_ms << ", \"mates\": " << mate_count << ", \"timeouts\": " << timeout_count << ", \"nodes\": " << total_node_count << ", \"time\": " << total_time << ", \"nps\": " << nodes_per_second(total_node_count, total_time) << ", \"mates_per_second\": " << mates_per_second << ", \"max_length\": " << max_length << ", \"lengths\": {";
+
+      for (const auto& length: lengths) {
+        std::cout << (length.first == lengths.begin()->first ? "" : ", ") << "\"" << length.first << "\": " << length.second;
+      }
+
+      std::cout << "}}" << std::endl;
+
+    } else {
+      std::cout << "positions = " << positions.size() << ", mates = " << mate_count << ", no mate = " << positions.size() - mate_count - timeout_count << ", timeouts = " << timeout_count << " (" << time_in_ms << " ms per position)" << std::endl;
+      std::cout << std::fixed << std::setprecision(3) << "time = " << total_time << " s, " << std::setprecision(1) << mates_per_second << " mates/s, " << std::setprecision(0) << nodes_per_second(total_node_count, total_time) << " nodes/s" << std::defaultfloat << std::endl;
+      std::cout << "length    mates" << std::endl;
+
+      for (const auto& length: lengths) {
+        std::cout << std::setw(6) << length.first << std::setw(9) << length.second << std::endl;
+      }
+    }
+  }
+
+  // Bariumサーバーとのメッセージの読み書き。ランダムな対局の手を、ptreeを使う版とバッファーから直接読み書きする版で変換して、1メッセージあたりの時間を比較します。
+
+  auto codec(int count, bool is_json) {
+    struct message final {
+      int turn;
+      barys::state state;
+      barys::action action;
+      std::string json;  // サーバーからのメッセージ（lastMoveを含むオブジェクト）。
+    };
+
+    auto messages      = std::vector<message>();
+    auto random_engine = std::mt19937(0);
+
+    while (static_cast<int>(messages.size()) < count) {
+      auto state = barys::state();
+
+      for (auto turn = 0; turn < 100 && !state.is_end() && static_cast<int>(messages.size()) < count; ++turn) {
+        const auto& actions = state.actions();
+        const auto& action  = actions[random_engine() % actions.size()];
+
+        auto ptree = boost::property_tree::ptree();
+        ptree.add_child("lastMove", barys::to_barium_move(action, turn, state));
+
+        messages.push_back(message{turn, state, action, barys::write_barium_json(ptree)});
+
+        state = state.next(action);
+      }
+    }
+
+    auto mismatch_count = 0;
+    auto size_sum       = std::size_t(0);  // 最適化で消されないように、書き込んだ大きさを合計します。
+
+    const auto& time = [&](const auto& function) {
+      const auto& starting_time = std::chrono::steady_clock::now();
+
+      for (const auto& message: messages) {
+        function(message);
+      }
+
+      return count ? elapsed_seconds(starting_time) / count * 1e9 : 0.0;
+    };
+
+    const auto& ptree_parse_time = time([&](const auto& message) {
+      const auto& ptree     = barys::read_barium_json(message.json);
+      const auto& last_move = ptree.get_child_optional("lastMove");
+
+      mismatch_count += !last_move || !(barys::from_barium_move(*last_move, message.turn, message.state) == message.action);
+    });
+
+    const auto& parse_time = time([&](const auto& message) {
+      mismatch_count += !(barys::parse_barium_message(message.json.data(), message.json.data() + message.json.size(), message.turn, message.state) == message.action);
+    });
+
+    const auto& ptree_encode_time = time([&](const auto& message) {
+      size_sum += barys::write_barium_json(barys::to_barium_move(message.action, message.turn, message.state)).size();
+    });
+
+    auto buffer = std::array<char, barys::max_barium_move_size>();
+
+    const auto& encode_time = time([&](const auto& message) {
+      size_sum += barys::encode_barium_move(message.action, message.turn, message.state, buffer.data());
+    });
+
+    // 直接書いたメッセージを、ptreeで読んで元の手に戻ることを確認します。
+
+    for (const auto& message: messages) {
+      const auto& size = barys::encode_barium_move(message.action, message.turn, message.state, buffer.data());
+
+      mismatch_count += !(barys::from_barium_move(barys::read_barium_json(std::string(buffer.data(), size)), message.turn, message.state) == message.action);
+    }
+
+    if (is_json) {
+      std::cout << "{\"benchmark\": \"codec\", \"messages\": " << count << ", \"ptree_parse_ns\": " << ptree_parse_time << ", \"parse_ns\": " << parse_time << ", \"ptree_encode_ns\": " << ptree_encode_time << ", \"encode_ns\": " << encode_time << ", \"mismatches\": " << mismatch_count << ", \"checksum\": " << size_sum << "}" << std::endl;
+    } else {
+      std::cout << "messages: " << count << ", mismatches: " << mismatch_count << " (checksum " << size_sum << ")" << std::endl;
+      std::cout << std::fixed << std::setprecision(1);
+      std::cout << "  parse,  ptree:  " << std::setw(8) << ptree_parse_time  << " ns/message" << std::endl;
+      std::cout << "  parse,  direct: " << std::setw(8) << parse_time        << " ns/message (" << (parse_time > 0 ? ptree_parse_time / parse_time : 0.0) << "x)" << std::endl;
+      std::cout << "  encode, ptree:  " << std::setw(8) << ptree_encode_time << " ns/message" << std::endl;
+      std::cout << "  encode, direct: " << std::setw(8) << encode_time       << " ns/message (" << (encode_time > 0 ? ptree_encode_time / encode_time : 0.0) << "x)" << std::defaultfloat << std::endl;
+    }
+  }
+
+  // スレッド数を変えて、同じ深さまで探索するのにかかる時間（time-to-depth）を比較します。
+
+  auto smp(const std::vector<std::string>& positions, int depth, std::size_t transposition_table_size, bool is_json) {
+    auto transposition_table = barys::transposition_table(transposition_table_size);
+
+    if (is_json) {
+      std::cout << "{\"benchmark\": \"smp\", \"depth\": " << depth << ", \"results\": [";
+    } else {
+      std::cout << "threads      time   speedup" << std::endl;
+    }
+
+    auto base_time = 0.0;
+
+    for (const auto& thread_count: {1, 2, 4, 8, 16}) {
+      auto time = 0.0;
+
+      for (const auto& position: positions) {
+        const auto& state = barys::to_state(position);
+
+        transposition_table.clear();
+
+        const auto& starting_time = std::chrono::steady_clock::now();
+
+        auto search_control = barys::search_control(std::chrono::steady_clock::time_point::max());
+
+        barys::alpha_beta(state, search_control, transposition_table, thread_count, depth)();
+
+        time += elapsed_seconds(starting_time);
+      }
+
+      if (thread_count == 1) {
+        base_time = time;
+      }
+
+      if (is_json) {
+        std::cout << (thread_count == 1 ? "" : ", ") << "{\"threads\": " << thread_count << ", \"time\": " << time << ", \"speedup\": " << base_time / time << "}";
+      } else {
+        std::cout << std::setw(7) << thread_count << std::fixed << std::setprecision(3) << std::setw(10) << time << std::setprecision(2) << std::setw(10) << base_time / time << std::defaultfloat << std::endl;
+      }
+    }
+
+    if (is_json) {
+      std::cout << "]}" << std::endl;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  auto options = boost::program_options::options_description("options");
+  options.add_options()
+    ("help", "print this message")
+    ("mode", boost::program_options::value<std::string>()->default_value("perft"), "benchmark to run (perft, search, eval, tablebase, mate, codec or smp)")
+    ("variant", boost::program_options::value<std::string>()->default_value("barium"), "game rules for perft and search (barium, or dobutsu without the try rule)")
+    ("positions", boost::program_options::value<std::string>(), "file with one position per line (default: built-in positions)")
+    ("depth", boost::program_options::value<int>()->default_value(5), "perft, search or eval depth")
+    ("weights", boost::program_options::value<std::string>(), "file with evaluation weights (default: built-in weights)")
+    ("tablebases", boost::program_options::value<std::string>(), "directory with endgame tablebases made by tablebase-generator")
+    ("probes", boost::program_options::value<int>()->default_value(100000), "number of random tablebase probes per tablebase")
+    ("mates", boost::program_options::value<int>()->default_value(200), "number of random positions for the mate solver (ignored with --positions)")
+    ("messages", boost::program_options::value<int>()->default_value(100000), "number of Barium messages for the codec benchmark")
+    ("hash", boost::program_options::value<std::size_t>()->default_value(256), "transposition table or mate solver table size in MB")
+    ("threads", boost::program_options::value<int>()->default_value(1), "number of search threads")
+    ("time", boost::program_options::value<int>()->default_value(0), "search for this many milliseconds per position instead of to a fixed depth")
+    ("no-pvs", "disable principal variation search")
+    ("no-aspiration", "disable aspiration windows")
+    ("no-null-move", "disable null move pruning")
+    ("no-lmr", "disable late move reductions")
+    ("batch-eval", "evaluate the children of depth 1 nodes in batches (experimental, slower search)")
+    ("json", "print results as JSON");
+
+  auto variables = boost::program_options::variables_map();
+
+  try {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), variables);
+    boost::program_options::notify(variables);
+
+  } catch (const boost::program_options::error& e) {
+    std::cerr << e.what() << std::endl << options << std::endl;
+
+    return 1;
+  }
+
+  if (variables.count("help")) {
+    std::cout << options << std::endl;
+
+    return 0;
+  }
+
+  try {
+    const auto& variant = variables["variant"].as<std::string>();
+    const auto& mode    = variables["mode"].as<std::string>();
+
+    if (variant != "barium" && (variant != "dobutsu" || (mode != "perft" && mode != "search"))) {
+      throw std::runtime_error("unknown variant " + variant + " for " + mode);
+    }
+
+    const auto& is_dobutsu = variant == "dobutsu";
+
+    if (variables.count("weights")) {
+      if (is_dobutsu) {
+        barys::current_evaluation_weights<barys::dobutsu_rules>() = barys::read_evaluation_weights<barys::dobutsu_rules>(variables["weights"].as<std::string>());
+      } else {
+        barys::current_evaluation_weights() = barys::read_evaluation_weights(variables["weights"].as<std::string>());
+      }
+    }
+
+    if (variables.count("tablebases")) {
+      barys::current_tablebases().load(variables["tablebases"].as<std::string>());
+    }
+
+    const auto& positions = variables.count("positions") ? read_positions(variables["positions"].as<std::string>()) : is_dobutsu ? default_dobutsu_positions : default_positions;
+
+    const auto& depth   = variables["depth"].as<int>();
+    const auto& is_json = variables.count("json") > 0;
+
+    if (mode == "perft") {
+      if (is_dobutsu) {
+        perft<barys::dobutsu_rules>(positions, depth, is_json);
+      } else {
+        perft<barys::barium_rules>(positions, depth, is_json);
+      }
+
+    } else if (mode == "search") {
+      auto options = barys::search_options();
+
+      options.is_principal_variation_search_enabled = !variables.count("no-pvs");
+      options.is_aspiration_window_enabled          = !variables.count("no-aspiration");
+      options.is_null_move_pruning_enabled          = !variables.count("no-null-move");
+      options.is_late_move_reduction_enabled        = !variables.count("no-lmr");
+      options.is_batch_evaluation_enabled           = variables.count("batch-eval") > 0;
+
+      if (is_dobutsu) {
+        search<barys::dobutsu_rules>(positions, depth, variables["time"].as<int>(), variables["hash"].as<std::size_t>(), variables["threads"].as<int>(), options, is_json);
+      } else {
+        search<barys::barium_rules>(positions, depth, variables["time"].as<int>(), variables["hash"].as<std::size_t>(), variables["threads"].as<int>(), options, is_json);
+      }
+
+    } else if (mode == "eval") {
+      evaluation(positions, depth, is_json);
+
+    } else if (mode == "tablebase") {
+      tablebase(variables["probes"].as<int>(), is_json);
+
+    } else if (mode == "mate") {
+      mate(variables.count("positions") ? positions : random_positions(variables["mates"].as<int>()), variables["time"].as<int>() ? variables["time"].as<int>() : 100, variables["hash"].as<std::size_t>(), is_json);
+
+    } else if (mode == "codec") {
+      codec(variables["messages"].as<int>(), is_json);
+
+    } else if (mode == "smp") {
+      smp(positions, depth, variables["hash"].as<std::size_t>(), is_json);
+
+    } else {
+      std::cerr << "unknown mode: " << mode << std::endl;
+
+      return 1;
+    }
+
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,149 +1,569 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/range/adaptors.hpp>
+#include <boost/range/algorithm.hpp>
 
 #include "alpha_beta.hpp"
+#include "barium_protocol.hpp"
 #include "game.hpp"
+#include "mate_solver.hpp"
+#include "opening_book.hpp"
+#include "search_control.hpp"
+#include "search_trace.hpp"
+#include "thread_pool.hpp"
+#include "transposition_table.hpp"
 
 namespace barys {
+  // Bariumサーバーとの1つの対局。io_contextと置換表は外から受け取るので、複数のbridgeで共有して、1つのプロセスで複数の対局ができます。
+  // thread_poolを指定した場合は、探索をスレッドプールで実行します。指定しない場合は、1手毎に探索のスレッドを作ります。
+
   class bridge final {
-    int   _turn;
-    state _state;
+    std::string                  _host;
+    std::string                  _port;
+    int                          _time_in_ms;     // 1手あたりの探索時間。サーバーの制限時間（15秒）から、通信などの時間を引いておきます。
+    int                          _time_limit_in_ms;  // サーバーの制限時間。読み込み終わってから書き込み終わるまでがこれを超えたら、締め切りに遅れたとして数えます。
+    int                          _turn;
+    state                        _state;
+    transposition_table&         _transposition_table;
+    thread_pool*                 _thread_pool;    // 探索を実行するスレッドプール。使用しない場合はnullptrです。
+    int                          _thread_count;
+    bool                         _is_pondering;
+    std::mt19937_64              _random_engine;  // 定跡の手を選ぶための乱数。
+    int                          _book_hit_count;
+    std::unique_ptr<mate_solver> _mate_solver;    // 探索と並行して動かす詰み探索。使用しない場合はnullptrです。
+    int                          _mate_count;
+
+    // 先読み（ponder）。相手の手番の間に、読み筋から予想した相手の手を指した局面を探索しておきます。
+
+    action                                _ponder_action;
+    state                                 _ponder_state;
+    std::unique_ptr<search_control>       _ponder_search_control;
+    std::unique_ptr<alpha_beta>           _ponder_search;
+    action                                _ponder_result;
+    std::thread                           _ponder_thread;
+    std::chrono::steady_clock::time_point _ponder_starting_time;
+    int                                   _ponder_count;
+    int                                   _ponder_hit_count;
+    std::chrono::steady_clock::duration   _ponder_saved_time;
+
+    // 通信。io_contextのスレッドで読み書きして、探索は別のスレッド（スレッドプールか、1手毎に作るスレッド）で実行します。
+    // バッファーは使い回すので、1手毎のメモリーの確保はありません。
+
+    boost::asio::io_context&                                      _io_context;
+    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> _websocket_stream;
+    boost::beast::flat_buffer                                     _read_buffer;
+    std::array<char, max_barium_move_size>                        _write_buffer;
+    std::future<void>                                             _search_future;
+    std::unique_ptr<search_control>                               _search_control;
+    std::unique_ptr<search_control>                               _mate_search_control;
+    action                                                        _next_action;
+    bool                                                          _is_closed;
+    std::chrono::steady_clock::time_point                         _read_starting_time;
+    std::chrono::steady_clock::time_point                         _turn_starting_time;
+    std::chrono::steady_clock::time_point                         _queue_starting_time;
+    std::chrono::steady_clock::time_point                         _search_starting_time;  // 探索のスレッドで書き込んで、探索の終了後にio_contextのスレッドで読みます。
+    std::chrono::steady_clock::time_point                         _search_ending_time;
+    std::chrono::steady_clock::time_point                         _write_starting_time;
+
+    // 1手毎の、段階毎の時間（ミリ秒）。readは相手の手番を待つ時間を含みます。queueは探索を依頼してから始まるまで（スレッドプールの待ち時間）です。
+    // turnは、読み込み終わってから書き込み終わるまでの時間です。
+
+    enum phase: int {read_phase, parse_phase, queue_phase, search_phase, encode_phase, write_phase, turn_phase, phase_count};
+
+    std::array<std::vector<double>, phase_count> _phase_times;
+    std::chrono::steady_clock::duration          _busy_time;  // 探索のスレッドを使った時間の合計。対局毎のCPUの配分の計算に使います。
+    int                                          _deadline_miss_count;
+
+#ifdef BARYS_SEARCH_TRACE
+    // 探索の記録の書き出し先。1手毎に1行のJSONを書きます。_trace_jsonは探索のスレッドで作って、on_searchedで書き出します。
+
+    std::ostream* _trace_stream;
+    int           _game_index;
+    std::string   _trace_json;
+#endif
 
   public:
-    bridge() noexcept: _turn(0), _state() {
+    bridge(boost::asio::io_context& io_context, transposition_table& transposition_table, thread_pool* thread_pool, const std::string& host, const std::string& port, int time_in_ms, int time_limit_in_ms, int thread_count, bool is_pondering, std::size_t mate_table_size) noexcept
+      : _host(host), _port(port), _time_in_ms(time_in_ms), _time_limit_in_ms(time_limit_in_ms), _turn(0), _state(), _transposition_table(transposition_table), _thread_pool(thread_pool), _thread_count(thread_count), _is_pondering(is_pondering), _random_engine(std::random_device()()), _book_hit_count(0), _mate_solver(mate_table_size > 0 ? std::make_unique<mate_solver>(mate_table_size) : nullptr), _mate_count(0), _ponder_action(), _ponder_state(), _ponder_search_control(), _ponder_search(), _ponder_result(), _ponder_thread(), _ponder_starting_time(), _ponder_count(0), _ponder_hit_count(0), _ponder_saved_time(), _io_context(io_context), _websocket_stream(_io_context), _read_buffer(), _write_buffer(), _search_future(), _search_control(), _mate_search_control(), _next_action(), _is_closed(false), _read_starting_time(), _turn_starting_time(), _queue_starting_time(), _search_starting_time(), _search_ending_time(), _write_starting_time(), _phase_times(), _busy_time(), _deadline_miss_count(0)
+#ifdef BARYS_SEARCH_TRACE
+      , _trace_stream(nullptr), _game_index(0), _trace_json()
+#endif
+    {
       ;
     }
 
   private:
-    auto from_barium_board(int index) const noexcept {
-      const auto& y = index / 7 - 1;
-      const auto& x = index % 7 - 1;
+    // 置換表から相手の最善手（読み筋の2手目）を取り出して、その手を指した局面の探索をバックグラウンドで開始します。
+
+    auto start_pondering() noexcept {
+      if (!_is_pondering || _state.is_end()) {
+        return;
+      }
+
+      const auto& entry = _transposition_table.probe(_state.hash());
+
+      if (!entry) {
+        return;
+      }
+
+      const auto& actions = _state.actions();
+
+      if (boost::find(actions, entry->move().action()) == std::end(actions)) {  // ハッシュ値の衝突で、合法手ではない手が入っている場合があります。
+        return;
+      }
+
+      _ponder_action         = entry->move().action();
+      _ponder_state          = _state.next(_ponder_action);
+      _ponder_search_control = std::make_unique<search_control>(std::chrono::steady_clock::time_point::max());  // 相手が指すまで時間制限なしで探索します。
+      _ponder_search         = std::make_unique<alpha_beta>(_ponder_state, *_ponder_search_control, _transposition_table, _thread_count);
+      _ponder_starting_time  = std::chrono::steady_clock::now();
+      _ponder_count++;
 
-      if (_turn % 2 == 0) {
-        return y * 5 + x;
+      _ponder_thread = std::thread([&]() { _ponder_result = (*_ponder_search)(); });
+    }
+
+    // 相手の手が予想通りなら、探索を止めずに制限時間を設定してtrueを返します。予想が外れた場合は探索を止めます。置換表の内容は、そのまま次の探索で使用します。
+
+    auto stop_pondering(const boost::optional<action>& last_action, const std::chrono::steady_clock::time_point& time_limit) noexcept {
+      if (!_ponder_thread.joinable()) {
+        return false;
+      }
+
+      const auto& is_hit = last_action && *last_action == _ponder_action;
+
+      if (is_hit) {
+        _ponder_search_control->set_time_limit(time_limit);
       } else {
-        return (5 - y) * 5 + (4 - x);
+        _ponder_search_control->stop();
+      }
+
+      const auto& now = std::chrono::steady_clock::now();
+
+      _ponder_thread.join();
+
+      if (is_hit) {
+        _ponder_hit_count++;
+        _ponder_saved_time += now - _ponder_starting_time;
       }
+
+      std::cerr << "ponder: " << (is_hit ? "hit" : "miss") << ", time = " << std::chrono::duration<double>(now - _ponder_starting_time).count() << " s" << std::endl;
+
+      return is_hit;
     }
 
-    auto from_barium_hand(int index) const noexcept {
-      for (const auto& count: _state.piece_counts_in_hand() | boost::adaptors::indexed()) {
-        if (index < count.value()) {
-          return static_cast<int>(count.index());
+    auto record_phase_time(phase phase, const std::chrono::steady_clock::time_point& starting_time, const std::chrono::steady_clock::time_point& ending_time) noexcept {
+      _phase_times[phase].emplace_back(std::chrono::duration<double, std::milli>(ending_time - starting_time).count());
+    }
+
+    // 段階毎の時間の分布。turnの最大値と制限時間の差が、_time_in_msを決めるための余裕です。
+
+    auto log_phase_times() noexcept {
+      static constexpr const char* phase_names[] = {"read", "parse", "queue", "search", "encode", "write", "turn"};
+
+      for (auto i = 0; i < phase_count; ++i) {
+        auto& times = _phase_times[i];
+
+        if (times.empty()) {
+          continue;
         }
 
-        index -= count.value();
+        std::sort(std::begin(times), std::end(times));
+
+        const auto& percentile = [&](double rate) {
+          return times[std::min(static_cast<std::size_t>(rate * times.size()), times.size() - 1)];
+        };
+
+        std::cerr << "latency: " << phase_names[i] << " (ms): p50 = " << percentile(0.5) << ", p90 = " << percentile(0.9) << ", p99 = " << percentile(0.99) << ", max = " << times.back() << std::endl;
+      }
+
+      if (!_phase_times[turn_phase].empty()) {
+        std::cerr << "latency: longest turn = " << _phase_times[turn_phase].back() << " ms, over the search time = " << _phase_times[turn_phase].back() - _time_in_ms << " ms, slack to " << _time_limit_in_ms << " ms = " << _time_limit_in_ms - _phase_times[turn_phase].back() << " ms, deadline misses = " << _deadline_miss_count << std::endl;
       }
+    }
+
+    auto log(const alpha_beta& search) const noexcept {
+      std::cerr << "depth = " << search.completed_depth() << ", score = " << search.best_score() << ", nodes = " << search.node_count() << ", qnodes = " << search.quiescence_node_count() << std::endl;
+      std::cerr << "transposition table: hit rate = " << search.hit_rate() << ", collision rate = " << search.collision_rate() << std::endl;
+      std::cerr << "move ordering: first move cutoff rate = " << search.first_move_cutoff_rate() << ", effective branching factor = " << search.effective_branching_factor() << std::endl;
+      std::cerr << "selective search: null moves = " << search.null_move_count() << ", null move cutoff rate = " << search.null_move_cutoff_rate() << ", reductions = " << search.reduction_count() << ", pvs re-searches = " << search.principal_variation_research_count() << ", aspiration re-searches = " << search.aspiration_research_count() << std::endl;
+      std::cerr << "search control: checks = " << search.check_count() << ", check overhead = " << search.check_overhead() << std::endl;
 
-      return -1;
+      if (search.tablebase_hit_count()) {
+        std::cerr << "tablebase: hits = " << search.tablebase_hit_count() << std::endl;
+      }
     }
 
-    auto parse_message(const std::string& message) const noexcept {
-      auto stream = std::stringstream(); stream << message;
-      auto ptree  = boost::property_tree::ptree();
+#ifdef BARYS_SEARCH_TRACE
+    // 探索の記録のJSON（オブジェクトのメンバーの並び）。searchがnullptrの場合は、探索しなかった（定跡の手を指した）場合です。
+    // 読み筋の手は、fromBoard-toか、持ち駒を打つ手は*fromCaptured-toで、Bariumの番号で書きます。
 
-      boost::property_tree::read_json(stream, ptree);
+    auto trace_json(const char* source, const alpha_beta* search) const {
+      auto stream = std::ostringstream();
 
-      const auto& from_board = ptree.get_optional<int>("lastMove.fromBoard");
-      const auto& from_hand  = ptree.get_optional<int>("lastMove.fromCaptured");
-      const auto& to         = ptree.get_optional<int>("lastMove.to");
+      const auto& milliseconds = [](const std::chrono::steady_clock::duration& duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+      };
 
-      return action(from_board ? from_barium_board(from_board.value()) : -1,
-                    from_hand  ? from_barium_hand(from_hand.value())   : -1,
-                    to         ? from_barium_board(to.value())         : -1);
-    }
+      stream << std::fixed << std::setprecision(3) << "\"source\":\"" << source << "\"";
 
-    auto to_barium_board(int index) const noexcept {
-      const auto& y = index / 5;
-      const auto& x = index % 5;
+      if (!search) {
+        return stream.str();
+      }
+
+      const auto& trace = search->trace();
+
+      stream << ",\"depth\":" << search->completed_depth() << ",\"score\":" << search->best_score() << ",\"nodes\":" << search->node_count() << ",\"qnodes\":" << search->quiescence_node_count() << ",\"time_ms\":" << milliseconds(search->time()) << ",\"stop\":\"" << to_string(trace.stop_reason) << "\"";
 
-      if (_turn % 2 == 0) {
-        return (y + 1) * 7 + (x + 1);
+      if (trace.stop_reason == stop_reason::timeout) {
+        stream << ",\"abort\":{\"depth\":" << trace.abort_depth << ",\"nodes\":" << trace.abort_node_count << ",\"time_ms\":" << milliseconds(trace.abort_time) << "}";
       } else {
-        return (6 - y) * 7 + (5 - x);
+        stream << ",\"abort\":null";
+      }
+
+      stream << ",\"cutoffs\":[";
+
+      for (auto i = 0; i < search_trace::cutoff_index_count; ++i) {
+        stream << (i > 0 ? "," : "") << trace.cutoff_indices[i];
+      }
+
+      stream << "],\"iterations\":[";
+
+      for (const auto& iteration: trace.iterations) {
+        stream << (&iteration != &trace.iterations.front() ? "," : "") << "{\"depth\":" << iteration.depth << ",\"score\":" << iteration.score << ",\"nodes\":" << iteration.node_count << ",\"qnodes\":" << iteration.quiescence_node_count << ",\"tt_hit_rate\":" << (iteration.probe_count ? static_cast<double>(iteration.hit_count) / iteration.probe_count : 0.0) << ",\"time_ms\":" << milliseconds(iteration.time) << ",\"pv\":[";
+
+        auto state = _state;
+
+        for (auto i = 0; i < static_cast<int>(iteration.principal_variation.size()); ++i) {
+          const auto& action = iteration.principal_variation[i];
+
+          stream << (i > 0 ? "," : "") << "\"";
+
+          if (action.from_board() != -1) {
+            stream << to_barium_board(_turn + i, action.from_board());
+          } else {
+            stream << "*" << to_barium_hand(state, action.from_hand());
+          }
+
+          stream << "-" << to_barium_board(_turn + i, action.to()) << "\"";
+
+          state = state.next(action);
+        }
+
+        stream << "]}";
       }
+
+      stream << "]";
+
+      return stream.str();
     }
+#endif
+
+    // 次の手を決めます。探索のスレッドで実行します。
+
+    auto search_next_action(const action& last_action, const std::chrono::steady_clock::time_point& time_limit) noexcept {
+      auto result = action();
+
+      const auto& is_ponder_hit = stop_pondering(last_action.to() >= 0 ? boost::make_optional(last_action) : boost::none, time_limit);
+      const auto& book_action   = is_ponder_hit ? boost::none : current_opening_book().probe(_state, _random_engine());
+
+      if (is_ponder_hit) {
+        result = _ponder_result;
 
-    auto to_barium_hand(int index) const noexcept {
-      int result = 0;
+        log(*_ponder_search);
 
-      for (const auto& count: _state.piece_counts_in_hand() | boost::adaptors::indexed()) {
-        if (count.index() == index) {
-          return result;
+#ifdef BARYS_SEARCH_TRACE
+        if (_trace_stream) {
+          _trace_json = trace_json("ponder", _ponder_search.get());
         }
+#endif
 
-        result += count.value();
+      } else if (book_action) {  // 定跡にある局面では、探索せずにすぐに指します。
+        result = *book_action;
+
+        _book_hit_count++;
+
+        std::cerr << "book: hit" << std::endl;
+
+#ifdef BARYS_SEARCH_TRACE
+        if (_trace_stream) {
+          _trace_json = trace_json("book", nullptr);
+        }
+#endif
+
+      } else {
+        auto mate_action = boost::optional<action>();
+        auto mate_thread = std::thread();
+
+        if (_mate_solver) {
+          mate_thread = std::thread([&]() {
+            mate_action = (*_mate_solver)(_state, *_mate_search_control);
+
+            if (mate_action) {  // 詰みが見つかったら、探索を止めます。
+              _search_control->stop();
+            }
+          });
+        }
+
+        auto search = alpha_beta(_state, *_search_control, _transposition_table, _thread_count);
+        result = search();
+
+        _mate_search_control->stop();
+
+        if (mate_thread.joinable()) {
+          mate_thread.join();
+        }
+
+        log(search);
+
+        if (mate_action) {
+          result = *mate_action;
+
+          _mate_count++;
+
+          std::cerr << "mate: length = " << _mate_solver->mate_length() << ", nodes = " << _mate_solver->node_count() << std::endl;
+        }
+
+#ifdef BARYS_SEARCH_TRACE
+        if (_trace_stream) {
+          _trace_json = trace_json(mate_action ? "mate" : "search", &search);
+        }
+#endif
       }
 
       return result;
     }
 
-    auto encode_message(const action& action) const noexcept {
-      auto stream = std::stringstream();
-      auto ptree  = boost::property_tree::ptree();
+    // 探索と先読みを止めて、探索のスレッドの終了を待ちます。
+    // スレッドプールの場合は、他の対局の探索で全てのスレッドが埋まっているとio_contextのスレッドが長く止まってしまうので、待ちません。
+    // 探索が終われば、on_searchedで後始末します。探索が終わるまでは、work_guardがio_contextの終了を止めておきます。
 
-      if (action.from_board() != -1) {
-        ptree.put<int>("fromBoard", to_barium_board(action.from_board()));
+    auto cancel() noexcept {
+      if (_search_control) {
+        _search_control->stop();
+        _mate_search_control->stop();
       }
 
-      if (action.from_hand() != -1) {
-        ptree.put<int>("fromCaptured", to_barium_hand(action.from_hand()));
+      if (_ponder_search_control) {
+        _ponder_search_control->stop();
       }
 
-      ptree.put<int>("to", to_barium_board(action.to()));
+      if (_search_future.valid() && !_thread_pool) {
+        _search_future.get();
+      }
 
-      boost::property_tree::write_json(stream, ptree);
+      stop_pondering(boost::none, std::chrono::steady_clock::now());
+    }
 
-      return stream.str();
+    auto on_searched() noexcept {
+      if (_search_future.valid()) {
+        _search_future.get();
+      }
+
+      if (_is_closed) {
+        return;
+      }
+
+      record_phase_time(queue_phase,  _queue_starting_time,  _search_starting_time);
+      record_phase_time(search_phase, _search_starting_time, _search_ending_time);
+      _busy_time += _search_ending_time - _search_starting_time;
+
+#ifdef BARYS_SEARCH_TRACE
+      if (_trace_stream) {
+        *_trace_stream << std::fixed << std::setprecision(3) << "{\"game\":" << _game_index << ",\"turn\":" << _turn << ",\"queue_ms\":" << _phase_times[queue_phase].back() << ",\"search_ms\":" << _phase_times[search_phase].back() << "," << _trace_json << "}" << std::endl;
+      }
+#endif
+
+      const auto& encode_starting_time = std::chrono::steady_clock::now();
+
+      const auto& size = encode_barium_move(_next_action, _turn, _state, _write_buffer.data());
+
+      _write_starting_time = std::chrono::steady_clock::now();
+      record_phase_time(encode_phase, encode_starting_time, _write_starting_time);
+
+      _websocket_stream.async_write(boost::asio::buffer(_write_buffer.data(), size), [&](const auto& error, auto) { on_written(error); });
+
+      _turn++;
+      _state = _state.next(_next_action);
+
+      start_pondering();
     }
 
-  public:
-    auto operator()() noexcept {
-      // TODO: リファクタリング。beastの使い方が分からなくて、サンプルをコピー＆ペーストした状態です。。。
+    auto on_written(const boost::beast::error_code& error) noexcept {
+      if (error) {
+        _is_closed = true;
+
+        cancel();
+
+        return;
+      }
+
+      _read_starting_time = std::chrono::steady_clock::now();
+      record_phase_time(write_phase, _write_starting_time, _read_starting_time);
+      record_phase_time(turn_phase,  _turn_starting_time,  _read_starting_time);
+
+      if (_read_starting_time - _turn_starting_time > std::chrono::milliseconds(_time_limit_in_ms)) {
+        _deadline_miss_count++;
+      }
+    }
+
+    // 読み込みは常に1つ待っておきます。探索中でも、サーバーが接続を閉じたらすぐに探索を止められます。
+
+    auto start_reading() noexcept -> void {
+      _websocket_stream.async_read(_read_buffer, [&](const auto& error, auto) { on_read(error); });
+    }
+
+    auto on_read(const boost::beast::error_code& error) {
+      if (error) {  // サーバーが接続を閉じた場合は、対局の終了です。
+        _is_closed = true;
+
+        cancel();
+
+        return;
+      }
+
+      if (_search_future.valid()) {  // 探索中に相手の手が届くことはないはずなので、読み捨てます。
+        std::cerr << "unexpected message while searching" << std::endl;
+
+        _read_buffer.consume(_read_buffer.size());
+        start_reading();
+
+        return;
+      }
+
+      const auto& turn_starting_time = std::chrono::steady_clock::now();
+      record_phase_time(read_phase, _read_starting_time, turn_starting_time);
+
+      const auto& time_limit  = turn_starting_time + std::chrono::milliseconds(_time_in_ms);  // スレッドプールで待たされた時間は、探索の時間から引かれます。
+      const auto& data        = static_cast<const char*>(_read_buffer.data().data());
+      auto        last_action = action();
 
       try {
-        boost::asio::io_context io_context;
-        boost::beast::websocket::stream<boost::asio::ip::tcp::socket> websocket_stream{io_context};
+        last_action = parse_barium_message(data, data + _read_buffer.size(), _turn, _state);
 
-        const auto& resolve_results = boost::asio::ip::tcp::resolver{io_context}.resolve("localhost", "8080");
-        boost::asio::connect(websocket_stream.next_layer(), std::begin(resolve_results), std::end(resolve_results));
+      } catch (const std::exception& e) {  // 他の対局を止めないように、例外は外に出さずにこの対局だけを終わらせます。
+        std::cerr << e.what() << std::endl;
 
-        websocket_stream.handshake("localhost", "/");
+        _is_closed = true;
 
-        for (;;) {
-          auto buffer = boost::beast::multi_buffer();
-          auto error  = boost::beast::error_code();
+        cancel();
 
-          websocket_stream.read(buffer, error);
+        auto error_code = boost::beast::error_code();
+        _websocket_stream.next_layer().close(error_code);
 
-          if (error == boost::beast::websocket::error::closed) {
-            break;
-          }
+        return;
+      }
 
-          const auto& last_action = parse_message(boost::beast::buffers_to_string(buffer.data()));
+      _read_buffer.consume(_read_buffer.size());
 
-          if (last_action.to() >= 0) {
-            _turn++;
-            _state = _state.next(last_action);
-          }
+      _turn_starting_time  = turn_starting_time;
+      _queue_starting_time = std::chrono::steady_clock::now();
+      record_phase_time(parse_phase, _turn_starting_time, _queue_starting_time);
 
-          const auto& next_action = alpha_beta(_state, std::chrono::system_clock::now() + std::chrono::milliseconds(14950))();
+      if (last_action.to() >= 0) {
+        _turn++;
+        _state = _state.next(last_action);
+      }
 
-          websocket_stream.write(boost::asio::buffer(encode_message(next_action)));
+      _search_control      = std::make_unique<search_control>(time_limit);
+      _mate_search_control = std::make_unique<search_control>(time_limit);
 
-          _turn++;
-          _state = _state.next(next_action);
-        }
+      // 探索が終わったら、io_contextのスレッドで書き込みます。探索中にio_contextが終了しないように、work_guardを持たせておきます。
+
+      const auto& search = [&, last_action, time_limit, work_guard = boost::asio::make_work_guard(_io_context)]() {
+        _search_starting_time = std::chrono::steady_clock::now();
+        _next_action          = search_next_action(last_action, time_limit);
+        _search_ending_time   = std::chrono::steady_clock::now();
+
+        boost::asio::post(_io_context, [&]() { on_searched(); });
+      };
+
+      _search_future = _thread_pool ? _thread_pool->submit(search) : std::async(std::launch::async, search);
+
+      start_reading();
+    }
+
+  public:
+    // 接続して、読み込みを開始します。対局は、io_contextのrunの中で進みます。
+
+    auto start() {
+      const auto& resolve_results = boost::asio::ip::tcp::resolver{_io_context}.resolve(_host, _port);
+      boost::asio::connect(_websocket_stream.next_layer(), std::begin(resolve_results), std::end(resolve_results));
+
+      _websocket_stream.handshake(_host, "/");
+
+      _read_starting_time = std::chrono::steady_clock::now();
+      start_reading();
+    }
+
+    auto log_summary() noexcept {
+      if (_mate_count > 0) {
+        std::cerr << "mate: found = " << _mate_count << std::endl;
+      }
+
+      if (_book_hit_count > 0) {
+        std::cerr << "book: hits = " << _book_hit_count << std::endl;
+      }
+
+      log_phase_times();
+
+      if (_ponder_count > 0) {
+        std::cerr << "ponder: hits = " << _ponder_hit_count << " / " << _ponder_count << ", hit rate = " << static_cast<double>(_ponder_hit_count) / _ponder_count << ", time saved = " << std::chrono::duration<double>(_ponder_saved_time).count() << " s" << std::endl;
+      }
+    }
+
+#ifdef BARYS_SEARCH_TRACE
+    // 探索の記録の書き出し先を設定します。game_indexは、複数の対局の記録を区別するための番号です。
+
+    auto set_trace_stream(std::ostream& trace_stream, int game_index) noexcept {
+      _trace_stream = &trace_stream;
+      _game_index   = game_index;
+    }
+#endif
+
+    auto turn_count() const noexcept {
+      return _phase_times[turn_phase].size();
+    }
+
+    const auto& queue_times() const noexcept {
+      return _phase_times[queue_phase];
+    }
+
+    auto busy_time() const noexcept {
+      return _busy_time;
+    }
+
+    auto deadline_miss_count() const noexcept {
+      return _deadline_miss_count;
+    }
+
+    // 1つの対局だけをする場合は、これを呼び出してください。io_contextのrunは、対局が終わるまで戻りません。
+
+    auto operator()() noexcept {
+      try {
+        start();
+
+        _io_context.run();
+
+        log_summary();
 
       } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
+
+        cancel();
       }
     }
   };
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+
+#include <immintrin.h>
+#include <nmmintrin.h>
+
+#include "evaluation_weights.hpp"
+#include "game.hpp"
+#include "position.hpp"
+
+namespace barys {
+  // 手番側から見た局面の評価値。駒とマス目と持ち駒の点数と利きの数はpositionが差分計算しているので、ここではそれを組み合わせるだけです。
+
+  // 駒とマス目と持ち駒の点数。利きの点数より先に計算して、遅延評価に使用します。
+
+  template <typename Rules>
+  inline auto material_score(const basic_position<Rules>& position) noexcept {
+    const auto& side = position.side();
+
+    // 駒とマス目。
+
+    auto result = position.piece_square_score(side) - position.piece_square_score(side ^ 1);
+
+    // 持ち駒。持ち駒が増えるほど終盤とみなして、序盤と終盤の点数を補間します。
+
+    const auto& hand_score       = position.hand_score(side);
+    const auto& enemy_hand_score = position.hand_score(side ^ 1);
+
+    constexpr auto max_phase = basic_evaluation_weights<Rules>::max_phase;
+
+    const auto& phase = std::min(position.phase(), max_phase);
+
+    result += ((hand_score[0] - enemy_hand_score[0]) * (max_phase - phase) + (hand_score[1] - enemy_hand_score[1]) * phase) / max_phase;
+
+    return result;
+  }
+
+  // 利きとライオンの安全度の点数の絶対値の上限。利きがあるマスの数の差はマス目の数以下、ライオンの周りのマスの数は8以下です。
+
+  template <typename Rules>
+  inline auto positional_score_bound(const basic_evaluation_weights<Rules>& weights) noexcept {
+    return Rules::square_count * std::abs(weights.control) + 8 * std::abs(weights.lion_attacked);
+  }
+
+  template <typename Rules>
+  inline auto evaluate(const basic_position<Rules>& position) noexcept {
+    const auto& weights = position.weights();
+    const auto& side    = position.side();
+
+    auto result = material_score(position);
+
+    // 利き。
+
+    const auto& controls       = position.controlled_bits(side);
+    const auto& enemy_controls = position.controlled_bits(side ^ 1);
+
+    result += (static_cast<int>(_mm_popcnt_u32(controls)) - static_cast<int>(_mm_popcnt_u32(enemy_controls))) * weights.control;
+
+    // ライオンの安全度。ライオンの周りのマスに相手の利きがあるほど危険です。
+
+    const auto& lion_attacked_count = [&](int side, std::uint32_t enemy_controls) {
+      const auto& lion_bits = position.pieces_on_board(side)[Rules::king];
+
+      return lion_bits ? static_cast<int>(_mm_popcnt_u32(Rules::side_controls[side][Rules::king][_tzcnt_u32(lion_bits)] & enemy_controls)) : 0;
+    };
+
+    result += (lion_attacked_count(side, enemy_controls) - lion_attacked_count(side ^ 1, controls)) * weights.lion_attacked;
+
+    return result;
+  }
+
+  // 遅延評価。駒の点数だけで(alpha, beta)の外になることが確定する場合は、利きを計算せずに上限か下限を返します。
+
+  template <typename Rules>
+  inline auto evaluate(const basic_position<Rules>& position, int alpha, int beta) noexcept {
+    const auto& score = material_score(position);
+    const auto& bound = positional_score_bound(position.weights());
+
+    if (score + bound <= alpha) {
+      return score + bound;
+    }
+
+    if (score - bound >= beta) {
+      return score - bound;
+    }
+
+    return evaluate(position);
+  }
+}
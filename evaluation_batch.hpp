@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <immintrin.h>
+#include <nmmintrin.h>
+
+#include "evaluation.hpp"
+#include "evaluation_weights.hpp"
+#include "game.hpp"
+#include "move.hpp"
+#include "position.hpp"
+
+namespace barys {
+  // 兄弟局面の一括評価。深さ1のノードで全ての子の局面の利きのビットボードを集めておいて、8局面ずつAVX2で評価します。
+  // 実験的な機能で、探索では既定で使いません（search_optionsのis_batch_evaluation_enabled）。
+  //
+  // 1局面分の評価は、addに渡した窓での遅延評価のevaluate(position, alpha, beta)と同じ値になります。駒の点数だけで(alpha, beta)の外になることが確定する局面は、利きを計算せずに上限か下限を入れておきます。
+  // AVX2が使えない場合（/arch:AVX2を指定しない場合）は、1局面ずつ_mm_popcnt_u32で計算します。
+
+  template <typename Rules>
+  class basic_evaluation_batch final {
+    using position = basic_position<Rules>;
+    using move     = basic_move<Rules>;
+
+  public:
+    static constexpr auto lane_count = 8;
+    static constexpr auto capacity   = (basic_move_stack<Rules>::max_move_count + lane_count - 1) / lane_count * lane_count;
+
+  private:
+    alignas(32) std::array<std::int32_t,  capacity> _material_scores;
+    alignas(32) std::array<std::uint32_t, capacity> _controls;          // 手番側（子の局面の手番側）の利きがあるマス目。
+    alignas(32) std::array<std::uint32_t, capacity> _enemy_controls;
+    alignas(32) std::array<std::uint32_t, capacity> _lion_areas;        // 手番側のライオンの周りのマス目。
+    alignas(32) std::array<std::uint32_t, capacity> _enemy_lion_areas;
+    alignas(32) std::array<std::int32_t,  capacity> _scores;
+    std::array<std::array<std::uint16_t, Rules::square_count>, Rules::square_count + Rules::king> _indices;  // 手（移動元と移動先）から、何番目の局面かを引きます。
+    int _size;
+
+    static auto lion_area(const position& position, int side) noexcept {
+      const auto& lion_bits = position.pieces_on_board(side)[Rules::king];
+
+      return lion_bits ? Rules::side_controls[side][Rules::king][_tzcnt_u32(lion_bits)] : 0u;
+    }
+
+#ifdef __AVX2__
+    // 32ビット毎のpopcount。AVX2にはないので、4ビット毎の表引き（pshufb）の結果を足し合わせます。
+
+    static auto popcount(const __m256i& bits) noexcept {
+      const auto& lookup   = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const auto& low_mask = _mm256_set1_epi8(0x0f);
+
+      const auto& byte_counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(bits, low_mask)), _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi32(bits, 4), low_mask)));
+
+      return _mm256_madd_epi16(_mm256_maddubs_epi16(byte_counts, _mm256_set1_epi8(1)), _mm256_set1_epi16(1));
+    }
+#endif
+
+  public:
+    basic_evaluation_batch() noexcept: _material_scores(), _controls(), _enemy_controls(), _lion_areas(), _enemy_lion_areas(), _scores(), _indices(), _size(0) {
+      ;
+    }
+
+    auto clear() noexcept {
+      _size = 0;
+    }
+
+    const auto& size() const noexcept {
+      return _size;
+    }
+
+    // moveをmakeした後の局面を追加します。alphaとbetaは、makeした後の局面の手番から見た値です。
+
+    auto add(const position& position, const move& move, int alpha, int beta) noexcept {
+      const auto& side  = position.side();
+      const auto& score = material_score(position);
+      const auto& bound = positional_score_bound(position.weights());
+
+      if (score + bound <= alpha || score - bound >= beta) {
+        _material_scores[_size]  = score + bound <= alpha ? score + bound : score - bound;  // 利きを0にしておけば、計算結果は上限か下限になります。
+        _controls[_size]         = 0;
+        _enemy_controls[_size]   = 0;
+        _lion_areas[_size]       = 0;
+        _enemy_lion_areas[_size] = 0;
+      } else {
+        _material_scores[_size]  = score;
+        _controls[_size]         = position.controlled_bits(side);
+        _enemy_controls[_size]   = position.controlled_bits(side ^ 1);
+        _lion_areas[_size]       = lion_area(position, side);
+        _enemy_lion_areas[_size] = lion_area(position, side ^ 1);
+      }
+
+      _indices[move.from()][move.to()] = static_cast<std::uint16_t>(_size);
+
+      _size++;
+    }
+
+    // 追加した全ての局面を評価します。端数の局面も8局面分まとめて計算して、余った分は使いません。
+
+    auto evaluate(const basic_evaluation_weights<Rules>& weights) noexcept {
+#ifdef __AVX2__
+      const auto& control_weight       = _mm256_set1_epi32(weights.control);
+      const auto& lion_attacked_weight = _mm256_set1_epi32(weights.lion_attacked);
+
+      for (auto i = 0; i < _size; i += lane_count) {
+        const auto& controls         = _mm256_load_si256(reinterpret_cast<const __m256i*>(&_controls[i]));
+        const auto& enemy_controls   = _mm256_load_si256(reinterpret_cast<const __m256i*>(&_enemy_controls[i]));
+        const auto& lion_areas       = _mm256_load_si256(reinterpret_cast<const __m256i*>(&_lion_areas[i]));
+        const auto& enemy_lion_areas = _mm256_load_si256(reinterpret_cast<const __m256i*>(&_enemy_lion_areas[i]));
+
+        const auto& control_counts       = _mm256_sub_epi32(popcount(controls), popcount(enemy_controls));
+        const auto& lion_attacked_counts = _mm256_sub_epi32(popcount(_mm256_and_si256(lion_areas, enemy_controls)), popcount(_mm256_and_si256(enemy_lion_areas, controls)));
+
+        const auto& scores = _mm256_add_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(&_material_scores[i])), _mm256_add_epi32(_mm256_mullo_epi32(control_counts, control_weight), _mm256_mullo_epi32(lion_attacked_counts, lion_attacked_weight)));
+
+        _mm256_store_si256(reinterpret_cast<__m256i*>(&_scores[i]), scores);
+      }
+#else
+      for (auto i = 0; i < _size; ++i) {
+        const auto& control_count       = static_cast<int>(_mm_popcnt_u32(_controls[i])) - static_cast<int>(_mm_popcnt_u32(_enemy_controls[i]));
+        const auto& lion_attacked_count = static_cast<int>(_mm_popcnt_u32(_lion_areas[i] & _enemy_controls[i])) - static_cast<int>(_mm_popcnt_u32(_enemy_lion_areas[i] & _controls[i]));
+
+        _scores[i] = _material_scores[i] + control_count * weights.control + lion_attacked_count * weights.lion_attacked;
+      }
+#endif
+    }
+
+    // moveをmakeした後の局面の評価値。evaluateの後で呼び出してください。
+
+    auto score(const move& move) const noexcept {
+      return static_cast<int>(_scores[_indices[move.from()][move.to()]]);
+    }
+  };
+
+  using evaluation_batch = basic_evaluation_batch<barium_rules>;
+}
@@ -0,0 +1,144 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "rules.hpp"
+
+// 評価関数の重み。起動時にファイルから読み込めるので、調整のために再コンパイルする必要はありません。
+//
+//   # コメント
+//   piece_square chick 0 0 0 0 0 100 100 ...   （マス目の数だけ。Bariumは30個。手番側から見て上の行から順。駒の点数を含みます）
+//   hand_opening 100 1000 1200                 （持ち駒のひよこ、ねこ、いぬの序盤の点数）
+//   hand_endgame 150 1100 1300                 （同じく終盤の点数）
+//   control 5                                  （利きがあるマス1つ毎の点数）
+//   lion_attacked -30                          （ライオンの周りの、相手の利きがあるマス1つ毎の点数）
+//
+// 駒の名前はchick、cat、dog、lion、chicken、power_up_catです（Bariumの場合。他のルールではpiece_definitionのnameです）。書かなかった項目は既定値のままです。
+
+namespace barys {
+  template <typename Rules>
+  struct basic_evaluation_weights final {
+    std::array<std::array<int, Rules::square_count>, Rules::piece_count> piece_square;  // 手番側から見た向きの、マス目毎の駒の点数です。
+    std::array<int, Rules::king> hand_opening;
+    std::array<int, Rules::king> hand_endgame;
+    int control;
+    int lion_attacked;
+
+    static constexpr auto max_phase = Rules::total_piece_count - 2;  // 持ち駒の数の合計がこれ以上（ライオン以外の全ての駒）なら終盤とします。
+
+    basic_evaluation_weights() noexcept: piece_square(), hand_opening(), hand_endgame(), control(5), lion_attacked(-30) {
+      // マス目毎の点数は、盤の大きさから作ります。Bariumの5×6の盤で調整した値です。
+
+      for (auto i = 0; i < Rules::piece_count; ++i) {
+        for (auto bit = 0; bit < Rules::square_count; ++bit) {
+          const auto& y = bit / Rules::width;
+          const auto& x = bit % Rules::width;
+          const auto& r = Rules::height - 1 - y;  // 自陣の一番下の行からの行数。
+
+          if (i == 0) {
+            piece_square[i][bit] = Rules::pieces[i].value + (y >= 1 && y <= Rules::height - 3 ? 40 >> (y - 1) : 0);  // ひよこは前に進むほど成りが近くなります。
+          } else if (i == Rules::king) {
+            piece_square[i][bit] = Rules::pieces[i].value + std::min(30, 40 - 20 * r);  // ライオンは自陣にいる方が安全です。
+          } else {
+            piece_square[i][bit] = Rules::pieces[i].value + (x == 0 || x == Rules::width - 1 ? 0 : x * 2 == Rules::width - 1 ? 15 : 10) + (y >= 1 && y <= Rules::height - 3 ? 10 : 0);  // 中央と、自陣から出たマス目を高くします。
+          }
+        }
+      }
+
+      // 持ち駒の点数。Bariumは調整済みで、終盤は持ち駒を高くします。他のルールでは、駒の点数だけにしておきます。
+
+      if constexpr (std::is_same_v<Rules, barium_rules>) {
+        hand_opening = {100, 1000, 1200};
+        hand_endgame = {150, 1100, 1300};
+      } else {
+        for (auto i = 0; i < Rules::king; ++i) {
+          hand_opening[i] = Rules::pieces[i].value;
+          hand_endgame[i] = Rules::pieces[i].value;
+        }
+      }
+    }
+  };
+
+  using evaluation_weights = basic_evaluation_weights<barium_rules>;
+
+  template <typename Rules = barium_rules>
+  inline auto read_evaluation_weights(const std::string& path) {
+    auto result = basic_evaluation_weights<Rules>();
+
+    auto stream = std::ifstream(path);
+
+    if (!stream) {
+      throw std::runtime_error("cannot open " + path);
+    }
+
+    const auto& read_value = [&](std::istringstream& line_stream, int& value, const std::string& name) {
+      if (!(line_stream >> value)) {
+        throw std::runtime_error("too few values for " + name + " in " + path);
+      }
+    };
+
+    const auto& read_values = [&](std::istringstream& line_stream, auto& values, const std::string& name) {
+      for (auto& value: values) {
+        read_value(line_stream, value, name);
+      }
+    };
+
+    for (auto line = std::string(); std::getline(stream, line);) {
+      auto line_stream = std::istringstream(line);
+      auto name        = std::string();
+
+      if (!(line_stream >> name) || name.front() == '#') {
+        continue;
+      }
+
+      if (name == "piece_square") {
+        auto piece_name = std::string();
+        line_stream >> piece_name;
+
+        auto i = 0;
+
+        while (i < Rules::piece_count && Rules::pieces[i].name != piece_name) {
+          ++i;
+        }
+
+        if (i == Rules::piece_count) {
+          throw std::runtime_error("unknown piece " + piece_name + " in " + path);
+        }
+
+        read_values(line_stream, result.piece_square[i], name);
+
+      } else if (name == "hand_opening") {
+        read_values(line_stream, result.hand_opening, name);
+
+      } else if (name == "hand_endgame") {
+        read_values(line_stream, result.hand_endgame, name);
+
+      } else if (name == "control") {
+        read_value(line_stream, result.control, name);
+
+      } else if (name == "lion_attacked") {
+        read_value(line_stream, result.lion_attacked, name);
+
+      } else {
+        throw std::runtime_error("unknown weight " + name + " in " + path);
+      }
+    }
+
+    return result;
+  }
+
+  // 探索で使用する重み。起動時に、必要ならread_evaluation_weightsの結果を設定します。
+
+  template <typename Rules = barium_rules>
+  inline auto& current_evaluation_weights() noexcept {
+    static auto result = basic_evaluation_weights<Rules>();
+
+    return result;
+  }
+}
@@ -11,80 +11,9 @@
 #include <boost/range/irange.hpp>
 #include <boost/range/numeric.hpp>
 
-namespace barys {
-  enum class piece_type: int {chick = 0, cat = 1, dog = 2, lion = 3, chicken = 4, power_up_cat = 5};
-
-  inline auto promoted(const piece_type& piece_type) noexcept {
-    switch (piece_type) {
-    case barys::piece_type::chick:
-      return barys::piece_type::chicken;
-
-    case barys::piece_type::cat:
-      return barys::piece_type::power_up_cat;
-
-    default:
-      return piece_type;
-    }
-  }
-
-  inline auto demoted(const piece_type& piece_type) noexcept {
-    switch (piece_type) {
-    case barys::piece_type::chicken:
-      return barys::piece_type::chick;
-
-    case barys::piece_type::power_up_cat:
-      return barys::piece_type::cat;
-
-    default:
-      return piece_type;
-    }
-  }
-
-  static constexpr auto board_bits      = 0b00111111111111111111111111111111;
-  static           auto enemy_side_bits = 0b00000000000000000000001111111111;  // _bittestの引数はlong *だったので、constexprにできませんでした。
-
-  inline auto control(const piece_type& piece_type, int bit) noexcept {
-    static constexpr std::uint32_t piece_controls[6] = {0b00001000000000000000000000000000,
-                                                        0b00011100000000000000000001010000,
-                                                        0b10011100000000000000000000100010,
-                                                        0b10011100000000000000000001110010,
-                                                        0b10011100000000000000000000100010,
-                                                        0b10011100000000000000000000100010};
-
-    static constexpr std::uint32_t control_masks[30] = {0b00000000000000000000000001100011,
-                                                        0b00000000000000000000000011100111,
-                                                        0b00000000000000000000000111001110,
-                                                        0b00000000000000000000001110011100,
-                                                        0b00000000000000000000001100011000,
-                                                        0b00000000000000000000110001100011,
-                                                        0b00000000000000000001110011100111,
-                                                        0b00000000000000000011100111001110,
-                                                        0b00000000000000000111001110011100,
-                                                        0b00000000000000000110001100011000,
-                                                        0b00000000000000011000110001100000,
-                                                        0b00000000000000111001110011100000,
-                                                        0b00000000000001110011100111000000,
-                                                        0b00000000000011100111001110000000,
-                                                        0b00000000000011000110001100000000,
-                                                        0b00000000001100011000110000000000,
-                                                        0b00000000011100111001110000000000,
-                                                        0b00000000111001110011100000000000,
-                                                        0b00000001110011100111000000000000,
-                                                        0b00000001100011000110000000000000,
-                                                        0b00000110001100011000000000000000,
-                                                        0b00001110011100111000000000000000,
-                                                        0b00011100111001110000000000000000,
-                                                        0b00111001110011100000000000000000,
-                                                        0b00110001100011000000000000000000,
-                                                        0b00000110001100000000000000000000,
-                                                        0b00001110011100000000000000000000,
-                                                        0b00011100111000000000000000000000,
-                                                        0b00111001110000000000000000000000,
-                                                        0b00110001100000000000000000000000};
-
-    return _rotl(piece_controls[static_cast<int>(piece_type)], bit) & control_masks[bit];
-  }
+#include "rules.hpp"
 
+namespace barys {
   class action final {
     int _from_board;
     int _from_hand;
@@ -116,37 +45,61 @@ namespace barys {
     return action_1.from_board() == action_2.from_board() && action_1.from_hand() == action_2.from_hand() && action_1.to() == action_2.to();
   }
 
-  class state final {
-    std::array<std::uint32_t, 6> _pieces_on_board;
-    std::array<int,           4> _piece_counts_in_hand;
-    std::array<std::uint32_t, 6> _enemy_pieces_on_board;
-    std::array<int,           4> _enemy_piece_counts_in_hand;
+  // 局面。盤面は常に手番側から見た向きで持つので、nextで盤面を180度回転して手番を入れ替えます。Rulesはbasic_rulesです。
 
-  public:
-    state(const std::array<std::uint32_t, 6>& pieces_on_board, const std::array<int, 4>& piece_counts_in_hand, const std::array<std::uint32_t, 6>& enemy_pieces_on_board, const std::array<int, 4>& enemy_piece_counts_in_hand) noexcept
-      : _pieces_on_board(pieces_on_board), _piece_counts_in_hand(piece_counts_in_hand), _enemy_pieces_on_board(enemy_pieces_on_board), _enemy_piece_counts_in_hand(enemy_piece_counts_in_hand)
+  template <typename Rules>
+  class basic_state final {
+    using pieces_on_board_type      = std::array<std::uint32_t, Rules::piece_count>;
+    using piece_counts_in_hand_type = std::array<int,           Rules::hand_piece_count>;
+
+    pieces_on_board_type      _pieces_on_board;
+    piece_counts_in_hand_type _piece_counts_in_hand;
+    pieces_on_board_type      _enemy_pieces_on_board;
+    piece_counts_in_hand_type _enemy_piece_counts_in_hand;
+    std::uint64_t             _hash;
+    std::uint64_t             _reversed_hash;  // 相手から見た場合のハッシュ値。nextで_hashと入れ替えます。
+
+    static auto calculate_hash(const pieces_on_board_type& pieces_on_board, const piece_counts_in_hand_type& piece_counts_in_hand, const pieces_on_board_type& enemy_pieces_on_board, const piece_counts_in_hand_type& enemy_piece_counts_in_hand, bool is_reversed) noexcept {
+      auto result = std::uint64_t(0);
+
+      for (auto i = 0; i < Rules::piece_count; ++i) {
+        for (auto piece_bits = pieces_on_board[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          result ^= is_reversed ? Rules::piece_key(1, i, Rules::square_count - 1 - _tzcnt_u32(piece_bits)) : Rules::piece_key(0, i, _tzcnt_u32(piece_bits));
+        }
+
+        for (auto piece_bits = enemy_pieces_on_board[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          result ^= is_reversed ? Rules::piece_key(0, i, Rules::square_count - 1 - _tzcnt_u32(piece_bits)) : Rules::piece_key(1, i, _tzcnt_u32(piece_bits));
+        }
+      }
+
+      for (auto i = 0; i < Rules::hand_piece_count; ++i) {
+        result ^= Rules::hand_key(is_reversed ? 1 : 0, i, piece_counts_in_hand[i]) ^ Rules::hand_key(is_reversed ? 0 : 1, i, enemy_piece_counts_in_hand[i]);
+      }
+
+      return result;
+    }
+
+    basic_state(const pieces_on_board_type& pieces_on_board, const piece_counts_in_hand_type& piece_counts_in_hand, const pieces_on_board_type& enemy_pieces_on_board, const piece_counts_in_hand_type& enemy_piece_counts_in_hand, std::uint64_t hash, std::uint64_t reversed_hash) noexcept
+      : _pieces_on_board(pieces_on_board), _piece_counts_in_hand(piece_counts_in_hand), _enemy_pieces_on_board(enemy_pieces_on_board), _enemy_piece_counts_in_hand(enemy_piece_counts_in_hand), _hash(hash), _reversed_hash(reversed_hash)
     {
       ;
     }
 
-    state() noexcept: state({0b00000000000001110000000000000000,
-                             0b00100010000000000000000000000000,
-                             0b00010100000000000000000000000000,
-                             0b00001000000000000000000000000000,
-                             0b00000000000000000000000000000000,
-                             0b00000000000000000000000000000000},
-                            {0, 0, 0, 0},
-                            {0b00000000000000000011100000000000,
-                             0b00000000000000000000000000010001,
-                             0b00000000000000000000000000001010,
-                             0b00000000000000000000000000000100,
-                             0b00000000000000000000000000000000,
-                             0b00000000000000000000000000000000},
-                            {0, 0, 0, 0})
+  public:
+    using rules = Rules;
+
+    basic_state(const pieces_on_board_type& pieces_on_board, const piece_counts_in_hand_type& piece_counts_in_hand, const pieces_on_board_type& enemy_pieces_on_board, const piece_counts_in_hand_type& enemy_piece_counts_in_hand) noexcept
+      : basic_state(pieces_on_board, piece_counts_in_hand, enemy_pieces_on_board, enemy_piece_counts_in_hand,
+                    calculate_hash(pieces_on_board, piece_counts_in_hand, enemy_pieces_on_board, enemy_piece_counts_in_hand, false),
+                    calculate_hash(pieces_on_board, piece_counts_in_hand, enemy_pieces_on_board, enemy_piece_counts_in_hand, true))
     {
       ;
     }
 
+    basic_state() noexcept: basic_state(Rules::initial_pieces, piece_counts_in_hand_type(), Rules::initial_enemy_pieces, piece_counts_in_hand_type()) {
+      ;
+    }
+
     const auto& pieces_on_board() const noexcept {
       return _pieces_on_board;
     }
@@ -163,8 +116,16 @@ namespace barys {
       return _enemy_piece_counts_in_hand;
     }
 
+    const auto& hash() const noexcept {
+      return _hash;
+    }
+
+    const auto& reversed_hash() const noexcept {
+      return _reversed_hash;
+    }
+
     const auto& is_end() const noexcept {
-      return _enemy_piece_counts_in_hand[static_cast<int>(piece_type::lion)];
+      return _enemy_piece_counts_in_hand[Rules::king];
     }
 
   private:
@@ -174,7 +135,7 @@ namespace barys {
 
       auto result = 0u;
 
-      for (auto i = 0; i < 6; ++i) {
+      for (auto i = 0; i < Rules::piece_count; ++i) {
         result |= pieces_on_board()[i];
       }
 
@@ -187,43 +148,104 @@ namespace barys {
 
       auto result = 0u;
 
-      for (auto i = 0; i < 6; ++i) {
+      for (auto i = 0; i < Rules::piece_count; ++i) {
         result |= enemy_pieces_on_board()[i];
       }
 
       return ~result;
     }
 
+    static auto control(int piece_type, int bit) noexcept {
+      return Rules::side_controls[0][piece_type][bit];
+    }
+
+  public:
+    // 手番側の駒の利きがあるマス目のビット。
+
+    auto controlled_bits() const noexcept {
+      auto result = 0u;
+
+      for (auto i = 0; i < Rules::piece_count; ++i) {
+        for (auto piece_bits = pieces_on_board()[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          result |= control(i, _tzcnt_u32(piece_bits));
+        }
+      }
+
+      return result;
+    }
+
+    // bitのマス目に利いている相手の駒のビット。相手の駒の利きは手番側の駒の利きを180度回転させたものなので、bitにある手番側の駒の利きと相手の駒が重なるかを調べれば十分です。
+
+    auto enemy_attacker_bits(int bit) const noexcept {
+      auto result = 0u;
+
+      for (auto i = 0; i < Rules::piece_count; ++i) {
+        result |= control(i, bit) & enemy_pieces_on_board()[i];
+      }
+
+      return result;
+    }
+
+    // 相手のライオンの前のマス目（to）にひよこを打つと詰みになる（相手のどの手でもライオンを取られる）ならtrueを返します。
+    // 盤上の駒は1マスずつしか動かないので、間に駒を打って防ぐことはできません。ライオンが逃げるか、ひよこを取るか、手番側のライオンを取るかしかありません。
+
+    auto is_chick_drop_mate(int to) const noexcept {
+      const auto& lion_bits = pieces_on_board()[Rules::king];
+
+      if (lion_bits && enemy_attacker_bits(_tzcnt_u32(lion_bits))) {  // 相手が手番側のライオンを取れる。
+        return false;
+      }
+
+      const auto& enemy_lion_bits = enemy_pieces_on_board()[Rules::king];
+      const auto& controlled_bits = basic_state::controlled_bits();
+
+      if (control(Rules::king, _tzcnt_u32(enemy_lion_bits)) & enemy_vacant_bits() & ~controlled_bits) {  // ライオンが逃げられる。打ったひよこを取る場合も含みます。
+        return false;
+      }
+
+      if (!(controlled_bits & enemy_lion_bits) && enemy_attacker_bits(to) & ~enemy_lion_bits) {  // ライオン以外の駒でひよこを取れば、ライオンに利きがなくなる。
+        return false;
+      }
+
+      return true;
+    }
+
+    // ひよこを打てるマス目のビット。詰み探索で王手になる手を生成する際にも使用します。
+
     auto chick_allowed_bits() const noexcept {
       auto result = 0u;
 
-      const auto& chick_bits = pieces_on_board()[static_cast<int>(piece_type::chick)];
+      const auto& chick_bits = pieces_on_board()[0];
 
-      for (auto i = 5; i <= 25; i += 5) {  // ひよこの後はダメ。シフトしてchick_bitsがまだ残っているかをチェックする方式より、無条件で5回まわす方が速かった。
+      for (auto i = Rules::width; i < Rules::square_count; i += Rules::width) {  // ひよこの後はダメ。シフトしてchick_bitsがまだ残っているかをチェックする方式より、無条件で全ての行の分をまわす方が速かった。
         result |= chick_bits << i;
       }
 
-      for (auto i = 5; i <= 25; i += 5) {  // ひよこの前もダメ。
+      for (auto i = Rules::width; i < Rules::square_count; i += Rules::width) {  // ひよこの前もダメ。
         result |= chick_bits >> i;
       }
 
-      result |= 0b00000000000000000000000000011111;  // 一番上の行は行き場所がなくなるのでダメ。
-      result |= enemy_pieces_on_board()[static_cast<int>(piece_type::lion)] << 5;  // ライオンの前は「打ちひよこ詰め」の可能性があるのでダメ。「打ちひよこ詰め」の判定は時間がかかるので、これで代用します。
+      result |= Rules::top_row_bits;  // 一番上の行は行き場所がなくなるのでダメ。
+
+      const auto& lion_front_bits = enemy_pieces_on_board()[Rules::king] << Rules::width & Rules::board_bits & vacant_bits() & enemy_vacant_bits() & ~result;
+
+      if (lion_front_bits && is_chick_drop_mate(_tzcnt_u32(lion_front_bits))) {  // 「打ちひよこ詰め」はダメ。
+        result |= lion_front_bits;
+      }
 
       return ~result;
     }
 
-  public:
     __forceinline auto actions() const noexcept {
-      auto result = boost::container::static_vector<action, 4 * 3 + 14 * 5 + 12 * 8 + 1 * 25 + 2 * 28>();
+      auto result = boost::container::static_vector<action, Rules::max_action_count>();
 
       // moves.
 
-      const auto& vacant_bits = state::vacant_bits();
+      const auto& vacant_bits = basic_state::vacant_bits();
 
-      for (auto i = 0; i < 6; ++i) {
+      for (auto i = 0; i < Rules::piece_count; ++i) {
         for (auto piece_bits = pieces_on_board()[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
-          for (auto control_bits = control(static_cast<piece_type>(i), _tzcnt_u32(piece_bits)) & vacant_bits; control_bits; control_bits = _blsr_u32(control_bits)) {
+          for (auto control_bits = control(i, _tzcnt_u32(piece_bits)) & vacant_bits; control_bits; control_bits = _blsr_u32(control_bits)) {
             result.emplace_back(_tzcnt_u32(piece_bits), -1, _tzcnt_u32(control_bits));
           }
         }
@@ -231,18 +253,17 @@ namespace barys {
 
       // drops.
 
-      const auto& enemy_vacant_bits  = state::enemy_vacant_bits();
-      const auto& chick_allowed_bits = state::chick_allowed_bits();
+      const auto& enemy_vacant_bits = basic_state::enemy_vacant_bits();
 
       if (piece_counts_in_hand()[0]) {
-        for (auto to_bits = board_bits & vacant_bits & enemy_vacant_bits & chick_allowed_bits; to_bits; to_bits = _blsr_u32(to_bits)) {
+        for (auto to_bits = Rules::board_bits & vacant_bits & enemy_vacant_bits & (Rules::is_chick_drop_restricted ? chick_allowed_bits() : ~0u); to_bits; to_bits = _blsr_u32(to_bits)) {
           result.emplace_back(-1, 0, _tzcnt_u32(to_bits));
         }
       }
 
-      for (auto i = 1; i < 3; ++i) {
+      for (auto i = 1; i < Rules::king; ++i) {
         if (piece_counts_in_hand()[i]) {
-          for (auto to_bits = board_bits & vacant_bits & enemy_vacant_bits; to_bits; to_bits = _blsr_u32(to_bits)) {
+          for (auto to_bits = Rules::board_bits & vacant_bits & enemy_vacant_bits; to_bits; to_bits = _blsr_u32(to_bits)) {
             result.emplace_back(-1, i, _tzcnt_u32(to_bits));
           }
         }
@@ -251,69 +272,90 @@ namespace barys {
       return result;
     }
 
-  private:
-    auto reverse(std::uint32_t piece_bits) const noexcept {
-      static constexpr std::uint8_t reversed[256] = {0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
-                                                     0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
-                                                     0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
-                                                     0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
-                                                     0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
-                                                     0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
-                                                     0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
-                                                     0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
-                                                     0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
-                                                     0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
-                                                     0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
-                                                     0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
-                                                     0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
-                                                     0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
-                                                     0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
-                                                     0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF};
-
-      return (reversed[piece_bits       & 0x000000ff] << 24 |
-              reversed[piece_bits >>  8 & 0x000000ff] << 16 |
-              reversed[piece_bits >> 16 & 0x000000ff] <<  8 |
-              reversed[piece_bits >> 24             ]);
+    // 駒を取る手と成る手だけを生成します。静止探索で使用します。
+
+    __forceinline auto capture_actions() const noexcept {
+      auto result = boost::container::static_vector<action, Rules::total_piece_count * 8>();
+
+      const auto& vacant_bits       = basic_state::vacant_bits();
+      const auto& enemy_vacant_bits = basic_state::enemy_vacant_bits();
+
+      for (auto i = 0; i < Rules::piece_count; ++i) {
+        const auto& target_bits = (Rules::board_bits & ~enemy_vacant_bits) | (Rules::is_promotable(i) ? Rules::promotion_bits & enemy_vacant_bits : 0);
+
+        for (auto piece_bits = pieces_on_board()[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          for (auto control_bits = control(i, _tzcnt_u32(piece_bits)) & vacant_bits & target_bits; control_bits; control_bits = _blsr_u32(control_bits)) {
+            result.emplace_back(_tzcnt_u32(piece_bits), -1, _tzcnt_u32(control_bits));
+          }
+        }
+      }
+
+      return result;
     }
 
-    __forceinline auto reverse(std::array<std::uint32_t, 6>* pieces_on_board) const noexcept {
-      for (auto i = 0; i < 6; ++i) {
-        pieces_on_board->data()[i] = reverse(pieces_on_board->data()[i] << 2);
+  private:
+    __forceinline auto reverse(pieces_on_board_type* pieces_on_board) const noexcept {
+      for (auto i = 0; i < Rules::piece_count; ++i) {
+        pieces_on_board->data()[i] = Rules::reverse(pieces_on_board->data()[i]);
       }
     }
 
   public:
     __forceinline auto next(const action& action) const noexcept {
-      auto next_pieces_on_board       = std::array<std::uint32_t, 6>(pieces_on_board());
-      auto next_piece_counts_in_hand  = std::array<int,           4>(piece_counts_in_hand());
-      auto next_enemy_pieces_on_board = std::array<std::uint32_t, 6>(enemy_pieces_on_board());
+      constexpr auto last_square = Rules::square_count - 1;
+
+      auto next_pieces_on_board       = pieces_on_board_type(pieces_on_board());
+      auto next_piece_counts_in_hand  = piece_counts_in_hand_type(piece_counts_in_hand());
+      auto next_enemy_pieces_on_board = pieces_on_board_type(enemy_pieces_on_board());
+      auto next_hash                  = hash();
+      auto next_reversed_hash         = reversed_hash();
 
       if (action.from_board() >= 0) {
-        for (auto i = 0; i < 6; ++i) {
+        for (auto i = 0; i < Rules::piece_count; ++i) {
           if (_bittestandreset(static_cast<long*>(static_cast<void*>(&next_enemy_pieces_on_board[i])), action.to())) {
-            next_piece_counts_in_hand[static_cast<int>(demoted(static_cast<piece_type>(i)))]++;
+            const auto& hand_index = Rules::demoted_pieces[i];
+            const auto& count      = next_piece_counts_in_hand[hand_index]++;
+
+            next_hash          ^= Rules::piece_key(1, i,               action.to()) ^ Rules::hand_key(0, hand_index, count) ^ Rules::hand_key(0, hand_index, count + 1);
+            next_reversed_hash ^= Rules::piece_key(0, i, last_square - action.to()) ^ Rules::hand_key(1, hand_index, count) ^ Rules::hand_key(1, hand_index, count + 1);
 
             break;
           }
         }
 
-        for (auto i = 0; i < 6; ++i) {
+        for (auto i = 0; i < Rules::piece_count; ++i) {
           if (_bittestandreset(static_cast<long*>(static_cast<void*>(&next_pieces_on_board[i])), action.from_board())) {
-            next_pieces_on_board[_bittest(static_cast<long*>(static_cast<void*>(&enemy_side_bits)), action.to()) ? static_cast<int>(promoted(static_cast<piece_type>(i))) : i] |= 1u << action.to();
+            const auto& to_index = Rules::promotion_bits >> action.to() & 1 ? Rules::promoted_pieces[i] : i;
+
+            next_pieces_on_board[to_index] |= 1u << action.to();
+
+            next_hash          ^= Rules::piece_key(0, i,               action.from_board()) ^ Rules::piece_key(0, to_index,               action.to());
+            next_reversed_hash ^= Rules::piece_key(1, i, last_square - action.from_board()) ^ Rules::piece_key(1, to_index, last_square - action.to());
 
             break;
           }
         }
 
       } else {
-        next_piece_counts_in_hand[action.from_hand()]--;
+        const auto& count = next_piece_counts_in_hand[action.from_hand()]--;
+
         next_pieces_on_board[action.from_hand()] |= 1u << action.to();
+
+        next_hash          ^= Rules::hand_key(0, action.from_hand(), count) ^ Rules::hand_key(0, action.from_hand(), count - 1) ^ Rules::piece_key(0, action.from_hand(),               action.to());
+        next_reversed_hash ^= Rules::hand_key(1, action.from_hand(), count) ^ Rules::hand_key(1, action.from_hand(), count - 1) ^ Rules::piece_key(1, action.from_hand(), last_square - action.to());
       }
 
       reverse(&next_pieces_on_board);
       reverse(&next_enemy_pieces_on_board);
 
-      return state(next_enemy_pieces_on_board, enemy_piece_counts_in_hand(), next_pieces_on_board, next_piece_counts_in_hand);
+      return basic_state(next_enemy_pieces_on_board, enemy_piece_counts_in_hand(), next_pieces_on_board, next_piece_counts_in_hand, next_reversed_hash, next_hash);
     }
   };
+
+  template <typename Rules>
+  inline auto hash_value(const basic_state<Rules>& state) noexcept {
+    return static_cast<std::size_t>(state.hash());
+  }
+
+  using state = basic_state<barium_rules>;
 }
@@ -1,9 +1,190 @@
-﻿#include <iostream>
+﻿#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <boost/program_options.hpp>
 
 #include "bridge.hpp"
+#include "evaluation_weights.hpp"
+#include "opening_book.hpp"
+#include "tablebase.hpp"
+#include "thread_pool.hpp"
+#include "transposition_table.hpp"
+
+namespace {
+  // 複数の対局を同時にします。探索は全ての対局で共有するスレッドプールで実行して、置換表も共有します（サイズは--hashの1つ分です）。
+  // 1つの探索が1つのスレッドを使うので、先読みと、探索と並行して動かす詰み探索は使用しません。
+
+  auto play_games(const std::string& host, const std::string& port, int game_count, int time_in_ms, int time_limit_in_ms, std::size_t transposition_table_size, int thread_count, [[maybe_unused]] std::ostream* trace_stream) {
+    auto io_context          = boost::asio::io_context();
+    auto transposition_table = barys::transposition_table(transposition_table_size);
+    auto thread_pool         = barys::thread_pool(thread_count);
+    auto bridges             = std::vector<std::unique_ptr<barys::bridge>>();
+
+    for (auto i = 0; i < game_count; ++i) {
+      bridges.emplace_back(std::make_unique<barys::bridge>(io_context, transposition_table, &thread_pool, host, port, time_in_ms, time_limit_in_ms, 1, false, 0));
+
+#ifdef BARYS_SEARCH_TRACE
+      if (trace_stream) {
+        bridges.back()->set_trace_stream(*trace_stream, i + 1);
+      }
+#endif
+
+      try {
+        bridges.back()->start();
+
+      } catch (const std::exception& e) {
+        std::cerr << "game " << i + 1 << ": " << e.what() << std::endl;
+      }
+    }
+
+    io_context.run();
+
+    auto total_busy_time = std::chrono::steady_clock::duration();
+    auto queue_times     = std::vector<double>();
+
+    for (const auto& bridge: bridges) {
+      total_busy_time += bridge->busy_time();
+      queue_times.insert(std::end(queue_times), std::begin(bridge->queue_times()), std::end(bridge->queue_times()));
+    }
+
+    for (auto i = 0; i < game_count; ++i) {
+      std::cerr << "game " << i + 1 << ":" << std::endl;
+
+      bridges[i]->log_summary();
+    }
+
+    std::sort(std::begin(queue_times), std::end(queue_times));
+
+    const auto& percentile = [&](double rate) {
+      return queue_times.empty() ? 0.0 : queue_times[std::min(static_cast<std::size_t>(rate * queue_times.size()), queue_times.size() - 1)];
+    };
+
+    // CPUの配分は、探索のスレッドを使った時間の割合です。スレッドプールのスレッドは1度に1つの探索しか実行しないので、CPUの時間とほぼ同じです。
+
+    auto deadline_miss_count = 0;
+
+    for (auto i = 0; i < game_count; ++i) {
+      const auto& share = total_busy_time.count() > 0 ? static_cast<double>(bridges[i]->busy_time().count()) / total_busy_time.count() : 0.0;
+
+      deadline_miss_count += bridges[i]->deadline_miss_count();
+
+      std::cerr << "game " << i + 1 << ": turns = " << bridges[i]->turn_count() << ", search time = " << std::fixed << std::setprecision(1) << std::chrono::duration<double>(bridges[i]->busy_time()).count() << " s, cpu share = " << share * 100 << " %, deadline misses = " << bridges[i]->deadline_miss_count() << std::endl;
+    }
+
+    std::cerr << "pool: threads = " << thread_pool.thread_count() << ", steals = " << thread_pool.steal_count() << ", queue delay (ms): p50 = " << percentile(0.5) << ", p90 = " << percentile(0.9) << ", p99 = " << percentile(0.99) << ", max = " << (queue_times.empty() ? 0.0 : queue_times.back()) << std::endl;
+    std::cerr << "deadline misses = " << deadline_miss_count << " (over " << time_limit_in_ms << " ms)" << std::endl;
+  }
+}
 
 int main(int argc, char** argv) {
-  barys::bridge()();
+  auto options = boost::program_options::options_description("options");
+  options.add_options()
+    ("help", "print this message")
+    ("host", boost::program_options::value<std::string>()->default_value("localhost"), "Barium server host")
+    ("port", boost::program_options::value<std::string>()->default_value("8080"), "Barium server port")
+    ("time", boost::program_options::value<int>()->default_value(14950), "search time per move in milliseconds (the server allows 15000)")
+    ("time-limit", boost::program_options::value<int>()->default_value(15000), "time the server allows per move in milliseconds (turns over this are counted as deadline misses)")
+    ("games", boost::program_options::value<int>()->default_value(1), "number of games played at the same time (more than 1 shares --threads and --hash between the games)")
+    ("hash", boost::program_options::value<std::size_t>()->default_value(256), "transposition table size in MB")
+    ("threads", boost::program_options::value<int>()->default_value(static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u))), "number of search threads")
+    ("ponder", "search the predicted reply while the opponent is thinking")
+    ("mate-hash", boost::program_options::value<std::size_t>()->default_value(64), "mate solver table size in MB (0 disables the mate solver running next to the search)")
+    ("weights", boost::program_options::value<std::string>(), "file with evaluation weights (default: built-in weights)")
+    ("tablebases", boost::program_options::value<std::string>(), "directory with endgame tablebases made by tablebase-generator")
+    ("book", boost::program_options::value<std::string>(), "opening book file made by opening-book-builder");
+
+#ifdef BARYS_SEARCH_TRACE
+  options.add_options()
+    ("trace", boost::program_options::value<std::string>(), "file to append search traces to (one JSON line per move)");
+#endif
+
+  auto variables = boost::program_options::variables_map();
+
+  try {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), variables);
+    boost::program_options::notify(variables);
+
+  } catch (const boost::program_options::error& e) {
+    std::cerr << e.what() << std::endl << options << std::endl;
+
+    return 1;
+  }
+
+  if (variables.count("help")) {
+    std::cout << options << std::endl;
+
+    return 0;
+  }
+
+  try {
+    if (variables.count("weights")) {
+      barys::current_evaluation_weights() = barys::read_evaluation_weights(variables["weights"].as<std::string>());
+    }
+
+    if (variables.count("tablebases")) {
+      std::cerr << "tablebases: " << barys::current_tablebases().load(variables["tablebases"].as<std::string>()) << " loaded" << std::endl;
+    }
+
+    if (variables.count("book")) {
+      barys::current_opening_book().load(variables["book"].as<std::string>());
+
+      std::cerr << "book: " << barys::current_opening_book().size() << " entries loaded" << std::endl;
+    }
+
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+
+    return 1;
+  }
+
+  auto trace_stream = std::ofstream();
+
+#ifdef BARYS_SEARCH_TRACE
+  if (variables.count("trace")) {
+    trace_stream.open(variables["trace"].as<std::string>(), std::ios::app);
+
+    if (!trace_stream) {
+      std::cerr << "cannot open " << variables["trace"].as<std::string>() << std::endl;
+
+      return 1;
+    }
+  }
+#endif
+
+  const auto game_count = std::max(variables["games"].as<int>(), 1);
+
+  if (game_count > 1) {
+    if (variables.count("ponder")) {
+      std::cerr << "ponder: disabled while playing multiple games" << std::endl;
+    }
+
+    play_games(variables["host"].as<std::string>(), variables["port"].as<std::string>(), game_count, variables["time"].as<int>(), variables["time-limit"].as<int>(), variables["hash"].as<std::size_t>(), variables["threads"].as<int>(), trace_stream.is_open() ? &trace_stream : nullptr);
+
+    return 0;
+  }
+
+  auto io_context          = boost::asio::io_context();
+  auto transposition_table = barys::transposition_table(variables["hash"].as<std::size_t>());
+
+  auto bridge = barys::bridge(io_context, transposition_table, nullptr, variables["host"].as<std::string>(), variables["port"].as<std::string>(), variables["time"].as<int>(), variables["time-limit"].as<int>(), variables["threads"].as<int>(), variables.count("ponder") > 0, variables["mate-hash"].as<std::size_t>());
+
+#ifdef BARYS_SEARCH_TRACE
+  if (trace_stream.is_open()) {
+    bridge.set_trace_stream(trace_stream, 1);
+  }
+#endif
+
+  bridge();
 
   return 0;
 }
@@ -0,0 +1,371 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <tuple>
+
+#include <boost/container/static_vector.hpp>
+#include <boost/optional.hpp>
+
+#include <immintrin.h>
+#include <nmmintrin.h>
+
+#include "game.hpp"
+#include "search_control.hpp"
+
+// 詰み探索（df-pn）。攻め方が王手（相手のライオンに利きがある状態）をかけ続けて、相手のライオンを取れるかを調べます。
+//
+// 攻め方の局面（ORノード）では王手になる手だけを、受け方の局面（ANDノード）では王手を外す手だけを生成するので、アルファ・ベータ探索よりずっと深く読めます。
+// 証明数と反証数は、手番側から見たφ（手番側が勝つことを示すのに必要な末端の数）とδ（手番側が負けることを示すのに必要な末端の数）で扱います。
+// 詰み手順の長さは、相手のライオンを取る手までの手数です。
+
+namespace barys {
+  class mate_solver final {
+  public:
+    static constexpr auto max_ply  = 32;  // これより長い手順は、詰まないとみなします。
+    static constexpr auto infinity = std::numeric_limits<std::uint32_t>::max() / 2;
+
+  private:
+    struct entry final {
+      std::uint64_t key;
+      std::uint32_t phi;
+      std::uint32_t delta;
+      std::uint32_t work;    // このノード以下で探索したノードの数。置き換えの優先度に使用します。
+      std::uint16_t length;      // 解けた場合の、相手のライオンを取るまでの手数。
+      std::uint16_t generation;  // 古い探索のエントリーは、使わずに置き換えます。
+    };
+
+    struct bucket final {
+      std::array<entry, 4> entries;
+    };
+
+    using action_vector = boost::container::static_vector<action, barium_rules::max_action_count>;
+
+    static constexpr std::uint64_t and_node_key = 0x9e3779b97f4a7c15;  // 手番側が受け方の局面は、同じ盤面でも攻め方の局面と区別します。
+
+    std::unique_ptr<bucket[]>              _buckets;
+    std::uint64_t                          _mask;
+    std::uint16_t                          _generation;
+    search_control*                        _search_control;
+    std::array<std::uint64_t, max_ply + 1> _path;  // 手順中の局面のハッシュ値。千日手の検出に使用します。
+    int                                    _check_countdown;
+    bool                                   _is_timeout;
+    std::uint64_t                          _node_count;
+    int                                    _mate_length;
+
+    static auto key(const state& state, bool is_or_node) noexcept {
+      return is_or_node ? state.hash() : state.hash() ^ and_node_key;
+    }
+
+    auto find(std::uint64_t key) const noexcept -> const entry* {
+      for (const auto& entry: _buckets[key & _mask].entries) {
+        if (entry.key == key && entry.generation == _generation) {
+          return &entry;
+        }
+      }
+
+      return nullptr;
+    }
+
+    auto store(std::uint64_t key, std::uint32_t phi, std::uint32_t delta, std::uint32_t work, int length) noexcept {
+      auto& entries = _buckets[key & _mask].entries;
+
+      const auto& priority = [&](const auto& entry) {  // 古い探索のエントリーと、探索量が少ないエントリーから置き換えます。
+        return entry.generation == _generation ? entry.work : 0;
+      };
+
+      auto it = std::find_if(std::begin(entries), std::end(entries), [&](const auto& entry) { return entry.key == key; });
+
+      if (it == std::end(entries)) {
+        it = std::min_element(std::begin(entries), std::end(entries), [&](const auto& entry_1, const auto& entry_2) { return priority(entry_1) < priority(entry_2); });
+      }
+
+      *it = entry{key, phi, delta, work, static_cast<std::uint16_t>(length), _generation};
+    }
+
+    // 相手のライオンに手番側の駒の利きがあれば、手番側はライオンを取って勝ちです。
+
+    static auto can_capture_lion(const state& state) noexcept {
+      return (state.controlled_bits() & state.enemy_pieces_on_board()[barium_rules::king]) != 0;
+    }
+
+    // 王手になる手。盤上の駒は1マスずつしか動かないので、動かした駒（成った場合は成った後の駒）の利きだけを調べれば十分です。
+    // 駒の種類毎に、相手のライオンに利くマス目を求めておいて、そこに動く手と打つ手だけを生成します。後手の利きは先手の利きを180度回転させたものなので、ライオンのマス目からの後手の利きが、そのマス目になります。
+
+    static auto checks(const state& state) noexcept {
+      auto result = action_vector();
+
+      const auto& lion_bit = static_cast<int>(_tzcnt_u32(state.enemy_pieces_on_board()[barium_rules::king]));
+
+      auto check_bits = std::array<std::uint32_t, barium_rules::piece_count>();
+
+      for (auto i = 0; i < barium_rules::piece_count; ++i) {
+        check_bits[i] = barium_rules::side_controls[1][i][lion_bit];
+      }
+
+      // moves. 成れる駒が相手の陣地に入ると成るので、相手の陣地では成った後の駒で調べます。
+
+      auto occupied_bits = 0u;
+
+      for (const auto& piece_bits: state.pieces_on_board()) {
+        occupied_bits |= piece_bits;
+      }
+
+      for (auto i = 0; i < barium_rules::piece_count; ++i) {
+        const auto& to_bits = barium_rules::is_promotable(i) ? (check_bits[i] & ~barium_rules::promotion_bits) | (check_bits[barium_rules::promoted_pieces[i]] & barium_rules::promotion_bits) : check_bits[i];
+
+        for (auto piece_bits = state.pieces_on_board()[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          for (auto control_bits = barium_rules::side_controls[0][i][_tzcnt_u32(piece_bits)] & to_bits & ~occupied_bits; control_bits; control_bits = _blsr_u32(control_bits)) {
+            result.emplace_back(_tzcnt_u32(piece_bits), -1, _tzcnt_u32(control_bits));
+          }
+        }
+      }
+
+      // drops. ひよこを打てるマス目の制限（「打ちひよこ詰め」を含みます）は、stateに任せます。
+
+      auto empty_bits = barium_rules::board_bits & ~occupied_bits;
+
+      for (const auto& piece_bits: state.enemy_pieces_on_board()) {
+        empty_bits &= ~piece_bits;
+      }
+
+      if (state.piece_counts_in_hand()[0]) {
+        for (auto to_bits = empty_bits & check_bits[0] & state.chick_allowed_bits(); to_bits; to_bits = _blsr_u32(to_bits)) {
+          result.emplace_back(-1, 0, _tzcnt_u32(to_bits));
+        }
+      }
+
+      for (auto i = 1; i < barium_rules::king; ++i) {
+        if (state.piece_counts_in_hand()[i]) {
+          for (auto to_bits = empty_bits & check_bits[i]; to_bits; to_bits = _blsr_u32(to_bits)) {
+            result.emplace_back(-1, i, _tzcnt_u32(to_bits));
+          }
+        }
+      }
+
+      return result;
+    }
+
+    // 王手を外す手。駒を打って利きを遮ることはできないので、ライオンが利きのないマス目に逃げるか、王手をかけている駒が1つならライオン以外の駒で取るかだけです。
+
+    static auto evasions(const state& state) noexcept {
+      auto result = action_vector();
+
+      const auto& lion_bit      = static_cast<int>(_tzcnt_u32(state.pieces_on_board()[barium_rules::king]));
+      const auto& attacker_bits = state.enemy_attacker_bits(lion_bit);
+
+      auto occupied_bits = 0u;
+
+      for (const auto& piece_bits: state.pieces_on_board()) {
+        occupied_bits |= piece_bits;
+      }
+
+      for (auto to_bits = barium_rules::side_controls[0][barium_rules::king][lion_bit] & ~occupied_bits; to_bits; to_bits = _blsr_u32(to_bits)) {
+        if (!state.enemy_attacker_bits(_tzcnt_u32(to_bits))) {
+          result.emplace_back(lion_bit, -1, _tzcnt_u32(to_bits));
+        }
+      }
+
+      if (_mm_popcnt_u32(attacker_bits) == 1) {
+        const auto& to = static_cast<int>(_tzcnt_u32(attacker_bits));
+
+        for (auto i = 0; i < barium_rules::piece_count; ++i) {
+          if (i == barium_rules::king) {
+            continue;
+          }
+
+          for (auto piece_bits = state.pieces_on_board()[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+            if (barium_rules::side_controls[0][i][_tzcnt_u32(piece_bits)] & attacker_bits) {
+              result.emplace_back(_tzcnt_u32(piece_bits), -1, to);
+            }
+          }
+        }
+      }
+
+      return result;
+    }
+
+    // 子ノードのφとδと手数。千日手と手数の上限は、攻め方の失敗として扱います（置換表には記録しません）。
+
+    auto child_numbers(const state& state, bool is_or_node, int ply) const noexcept {
+      auto is_repeated = ply > max_ply;
+
+      for (auto i = ply - 2; i >= 0 && !is_repeated; i -= 2) {  // 手番が同じ局面とだけ比較します。
+        is_repeated = _path[i] == state.hash();
+      }
+
+      if (is_repeated) {
+        return is_or_node ? std::make_tuple(infinity, std::uint32_t(0), 0) : std::make_tuple(std::uint32_t(0), infinity, 0);
+      }
+
+      const auto& entry = find(key(state, is_or_node));
+
+      return entry ? std::make_tuple(entry->phi, entry->delta, static_cast<int>(entry->length)) : std::make_tuple(std::uint32_t(1), std::uint32_t(1), 0);
+    }
+
+    // 多重反復深化（MID）。φかδが閾値以上になるまで、δが最小の子ノードを展開します。探索したノードの数を返します。
+
+    auto search(const state& state, bool is_or_node, std::uint32_t phi_threshold, std::uint32_t delta_threshold, int ply) noexcept -> std::uint32_t {
+      _node_count++;
+
+      if (--_check_countdown <= 0) {
+        _check_countdown = search_control::check_interval;
+
+        if (_search_control->check()) {
+          _is_timeout = true;
+        }
+      }
+
+      if (_is_timeout) {
+        return 0;
+      }
+
+      const auto& key = mate_solver::key(state, is_or_node);
+
+      _path[ply] = state.hash();
+
+      // 末端。攻め方が相手のライオンを取れる場合と、受け方が攻め方のライオンを取れる場合は、手番側の勝ちです。
+
+      if (can_capture_lion(state)) {
+        store(key, 0, infinity, 1, 1);
+
+        return 1;
+      }
+
+      const auto& actions = is_or_node ? checks(state) : evasions(state);
+
+      if (actions.empty()) {  // 攻め方は王手をかけられないので失敗、受け方は逃げられないので詰み（受け方が何か指して、攻め方がライオンを取るので2手）です。
+        store(key, infinity, 0, 1, is_or_node ? 0 : 2);
+
+        return 1;
+      }
+
+      auto work = std::uint32_t(1);
+
+      for (;;) {
+        auto phi               = infinity;
+        auto delta             = std::uint32_t(0);
+        auto won_length        = max_ply + 1;
+        auto lost_length       = 0;
+        auto best_index        = 0;
+        auto best_delta        = infinity + 1;  // δが無限大の子ノードしかない場合も、最初の子ノードを選びます。
+        auto best_phi          = std::uint32_t(0);
+        auto second_best_delta = infinity;
+
+        for (auto i = 0; i < static_cast<int>(actions.size()); ++i) {
+          std::uint32_t child_phi;
+          std::uint32_t child_delta;
+          int           child_length;
+
+          std::tie(child_phi, child_delta, child_length) = child_numbers(state.next(actions[i]), !is_or_node, ply + 1);
+
+          phi   = std::min(phi, child_delta);
+          delta = std::min(delta + child_phi, infinity);
+
+          if (child_delta == 0) {  // 勝てる手が複数ある場合は最も短い手順を、負ける場合は最も長い手順を手数にします。
+            won_length = std::min(won_length, child_length + 1);
+          }
+
+          lost_length = std::max(lost_length, child_length + 1);
+
+          if (child_delta < best_delta) {
+            second_best_delta = std::min(second_best_delta, best_delta);
+            best_delta        = child_delta;
+            best_phi          = child_phi;
+            best_index        = i;
+
+          } else if (child_delta < second_best_delta) {
+            second_best_delta = child_delta;
+          }
+        }
+
+        if (phi >= phi_threshold || delta >= delta_threshold || _is_timeout) {
+          store(key, phi, delta, work, phi == 0 ? won_length : lost_length);
+
+          return work;
+        }
+
+        const auto  child_phi_threshold   = std::min(delta_threshold - delta + best_phi, infinity);
+        const auto  child_delta_threshold = std::min(phi_threshold, second_best_delta + 1);
+
+        work += search(state.next(actions[best_index]), !is_or_node, child_phi_threshold, child_delta_threshold, ply + 1);
+      }
+    }
+
+  public:
+    mate_solver(std::size_t table_size_in_mb) noexcept: _buckets(), _mask(0), _generation(0), _search_control(nullptr), _path(), _check_countdown(search_control::check_interval), _is_timeout(false), _node_count(0), _mate_length(0) {
+      auto bucket_count = std::size_t(1);
+
+      while (bucket_count * 2 * sizeof(bucket) <= table_size_in_mb * 1024 * 1024) {
+        bucket_count *= 2;
+      }
+
+      _buckets = std::unique_ptr<bucket[]>(new bucket[bucket_count]());
+      _mask    = bucket_count - 1;
+    }
+
+    // 手番側が相手のライオンを取れることを証明できたら、最初の手を返します。詰まない場合と、時間切れの場合は、boost::noneを返します。
+    // 手数の上限で打ち切った結果が残らないように、探索毎に世代を変えて、前の探索のエントリーは使いません。
+
+    auto operator()(const state& state, search_control& search_control) noexcept {
+      _generation++;
+
+      _search_control  = &search_control;
+      _check_countdown = search_control::check_interval;
+      _is_timeout      = false;
+      _node_count      = 0;
+      _mate_length     = 0;
+
+      if (state.is_end()) {
+        return boost::optional<action>();
+      }
+
+      search(state, true, infinity, infinity, 0);
+
+      const auto& root_entry = find(key(state, true));
+
+      if (!root_entry || root_entry->phi != 0) {
+        return boost::optional<action>();
+      }
+
+      _mate_length = root_entry->length;
+
+      if (can_capture_lion(state)) {
+        const auto& lion_bit = static_cast<int>(_tzcnt_u32(state.enemy_pieces_on_board()[barium_rules::king]));
+
+        for (const auto& action: state.actions()) {
+          if (action.to() == lion_bit) {
+            return boost::make_optional(action);
+          }
+        }
+      }
+
+      for (const auto& action: checks(state)) {
+        const auto& entry = find(key(state.next(action), false));
+
+        if (entry && entry->delta == 0 && entry->length + 1 == _mate_length) {
+          return boost::make_optional(action);
+        }
+      }
+
+      return boost::optional<action>();  // 置換表から証明に必要なエントリーが追い出された場合です。
+    }
+
+    const auto& node_count() const noexcept {
+      return _node_count;
+    }
+
+    // 詰みを証明した場合の、相手のライオンを取るまでの手数。
+
+    const auto& mate_length() const noexcept {
+      return _mate_length;
+    }
+
+    const auto& is_timeout() const noexcept {
+      return _is_timeout;
+    }
+  };
+}
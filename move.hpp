@@ -0,0 +1,161 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "game.hpp"
+
+namespace barys {
+  // 探索用の手。16ビットに詰めて、置換表やキラー手にそのまま格納できるようにします。マス目は、actionと同じく手番側から見た向きです。
+
+  template <typename Rules>
+  class basic_move final {
+    static_assert(Rules::square_count + Rules::hand_piece_count <= 64, "the move must fit in 16 bits");
+
+    std::uint16_t _value;  // 下位から順に、移動先5ビット、移動元6ビット（盤上はマス目、持ち駒はマス目の数 + 駒の種類）、成り1ビットです。0は手がないことを表します。
+
+  public:
+    constexpr basic_move() noexcept: _value(0) {
+      ;
+    }
+
+    constexpr basic_move(int from, int to, bool is_promotion) noexcept: _value(static_cast<std::uint16_t>(to | from << 5 | (is_promotion ? 1 << 11 : 0))) {
+      ;
+    }
+
+    explicit constexpr basic_move(std::uint16_t value) noexcept: _value(value) {
+      ;
+    }
+
+    auto value() const noexcept {
+      return _value;
+    }
+
+    auto to() const noexcept {
+      return static_cast<int>(_value & 0b11111);
+    }
+
+    // 移動元。Bariumなら、盤上は0〜29、持ち駒は30〜33です。
+
+    auto from() const noexcept {
+      return static_cast<int>(_value >> 5 & 0b111111);
+    }
+
+    auto is_drop() const noexcept {
+      return from() >= Rules::square_count;
+    }
+
+    auto from_board() const noexcept {
+      return is_drop() ? -1 : from();
+    }
+
+    auto from_hand() const noexcept {
+      return is_drop() ? from() - Rules::square_count : -1;
+    }
+
+    auto is_promotion() const noexcept {
+      return (_value >> 11 & 1) != 0;
+    }
+
+    auto action() const noexcept {
+      return barys::action(from_board(), from_hand(), to());
+    }
+  };
+
+  template <typename Rules>
+  inline auto operator==(const basic_move<Rules>& move_1, const basic_move<Rules>& move_2) noexcept {
+    return move_1.value() == move_2.value();
+  }
+
+  template <typename Rules>
+  inline auto operator!=(const basic_move<Rules>& move_1, const basic_move<Rules>& move_2) noexcept {
+    return move_1.value() != move_2.value();
+  }
+
+  // 探索スレッド毎の手のスタック。探索開始時に一度だけ確保して、各局面の手はその続きに書き込みます。
+
+  template <typename Rules>
+  class basic_move_stack final {
+    using move = basic_move<Rules>;
+
+    std::vector<move> _moves;
+    std::vector<int>  _scores;
+    int               _size;
+
+  public:
+    static constexpr auto max_move_count = Rules::max_action_count;  // 1局面の合法手の数の上限。
+    static constexpr auto max_ply        = 128;
+
+    basic_move_stack() noexcept: _moves(max_ply * max_move_count), _scores(max_ply * max_move_count), _size(0) {
+      ;
+    }
+
+    auto top_moves() noexcept {
+      return _moves.data() + _size;
+    }
+
+    auto top_scores() noexcept {
+      return _scores.data() + _size;
+    }
+
+    auto push(int count) noexcept {
+      _size += count;
+    }
+
+    auto pop(int count) noexcept {
+      _size -= count;
+    }
+  };
+
+  // 1つの局面の手。move_stackの一部を使用して、スコープを抜けるとスタックから取り除きます。
+
+  template <typename Rules>
+  class basic_move_list final {
+    using move       = basic_move<Rules>;
+    using move_stack = basic_move_stack<Rules>;
+
+    move_stack& _move_stack;
+    move*       _moves;
+    int*        _scores;
+    int         _size;
+
+  public:
+    // generateには、書き込み先を受け取って書き込んだ手の数を返す関数を渡します。
+
+    template <typename Generate>
+    basic_move_list(move_stack& move_stack, Generate generate) noexcept: _move_stack(move_stack), _moves(move_stack.top_moves()), _scores(move_stack.top_scores()), _size(generate(_moves)) {
+      _move_stack.push(_size);
+    }
+
+    basic_move_list(const basic_move_list&) = delete;
+    basic_move_list& operator=(const basic_move_list&) = delete;
+
+    ~basic_move_list() {
+      _move_stack.pop(_size);
+    }
+
+    auto size() const noexcept {
+      return static_cast<std::size_t>(_size);
+    }
+
+    auto empty() const noexcept {
+      return _size == 0;
+    }
+
+    auto& operator[](int index) noexcept {
+      return _moves[index];
+    }
+
+    const auto& operator[](int index) const noexcept {
+      return _moves[index];
+    }
+
+    auto scores() noexcept {
+      return _scores;
+    }
+  };
+
+  using move       = basic_move<barium_rules>;
+  using move_stack = basic_move_stack<barium_rules>;
+  using move_list  = basic_move_list<barium_rules>;
+}
@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "move.hpp"
+#include "position.hpp"
+
+namespace barys {
+  // 手の並べ替え。置換表の手、駒を取る手（MVV-LVA）、キラー手、ヒストリーの順に並べます。探索スレッド毎に1つ使用します。
+
+  template <typename Rules>
+  class basic_move_ordering final {
+    using position   = basic_position<Rules>;
+    using move       = basic_move<Rules>;
+    using move_stack = basic_move_stack<Rules>;
+
+    static constexpr auto max_ply = move_stack::max_ply;
+
+    std::array<std::array<move, 2>, max_ply>                                           _killers;
+    std::array<std::array<int, Rules::square_count>, Rules::square_count + Rules::king> _history;  // 移動元（盤上はマス目、持ち駒はマス目の数 + 駒の種類）と移動先で引きます。
+
+    static auto piece_value(int piece_type) noexcept {
+      return Rules::pieces[piece_type].capture_order;
+    }
+
+  public:
+    // 点数の区分。ヒストリーの点数はkiller_scoreより小さくなるようにします。
+
+    static constexpr auto hash_move_score = 1 << 30;
+    static constexpr auto capture_score   = 1 << 29;
+    static constexpr auto killer_score    = 1 << 28;
+
+    basic_move_ordering() noexcept: _killers(), _history() {
+      ;
+    }
+
+    static auto is_capture(const position& position, const move& move) noexcept {
+      return !move.is_drop() && position.enemy_piece_type_at(move.to()) >= 0;
+    }
+
+    // 手に点数を付けて、scoresに書き込みます。並べ替えはpickで1手ずつ行います。カットは最初の数手で起きることがほとんどなので、全体をソートするより速いです。
+    // hash_moveは置換表の手で、ない場合はmove()です。
+
+    template <typename Moves, typename Scores>
+    auto score(const position& position, const Moves& moves, Scores& scores, const move& hash_move, int ply) const noexcept {
+      const auto& killers = _killers[std::min(ply, max_ply - 1)];
+
+      for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+        const auto& move = moves[i];
+
+        if (move == hash_move) {
+          scores[i] = hash_move_score;
+          continue;
+        }
+
+        if (!move.is_drop()) {
+          const auto& captured_piece_type = position.enemy_piece_type_at(move.to());
+
+          if (captured_piece_type >= 0) {
+            scores[i] = capture_score + piece_value(captured_piece_type) * 16 - piece_value(position.piece_type_at(move.from()));
+            continue;
+          }
+        }
+
+        if (move == killers[0]) {
+          scores[i] = killer_score + 1;
+          continue;
+        }
+
+        if (move == killers[1]) {
+          scores[i] = killer_score;
+          continue;
+        }
+
+        scores[i] = _history[move.from()][move.to()];
+      }
+    }
+
+    // index番目以降で最も点数が高い手を、index番目に移動します。
+
+    template <typename Moves, typename Scores>
+    static auto pick(Moves& moves, Scores& scores, int index) noexcept {
+      auto best_index = index;
+
+      for (auto i = index + 1; i < static_cast<int>(moves.size()); ++i) {
+        if (scores[i] > scores[best_index]) {
+          best_index = i;
+        }
+      }
+
+      std::swap(moves[index],  moves[best_index]);
+      std::swap(scores[index], scores[best_index]);
+    }
+
+    template <typename Moves>
+    auto sort(const position& position, Moves& moves, const move& hash_move, int ply) const noexcept {
+      std::array<int, move_stack::max_move_count> scores;  // 使う分だけ設定するので、初期化しません。
+
+      score(position, moves, scores, hash_move, ply);
+
+      for (auto i = 0; i < static_cast<int>(moves.size()); ++i) {
+        pick(moves, scores, i);
+      }
+    }
+
+    // ベータ・カットを起こした手を記録します。駒を取る手は、MVV-LVAで十分に前に来るので記録しません。
+
+    auto update(const position& position, const move& move, int depth, int ply) noexcept {
+      if (is_capture(position, move)) {
+        return;
+      }
+
+      auto& killers = _killers[std::min(ply, max_ply - 1)];
+
+      if (move != killers[0]) {
+        killers[1] = killers[0];
+        killers[0] = move;
+      }
+
+      auto& history = _history[move.from()][move.to()];
+
+      history += depth * depth;
+
+      if (history >= killer_score / 2) {  // キラー手より前に来ないように、大きくなりすぎたら全体を半分にします。
+        for (auto& row: _history) {
+          for (auto& value: row) {
+            value /= 2;
+          }
+        }
+      }
+    }
+  };
+
+  using move_ordering = basic_move_ordering<barium_rules>;
+}
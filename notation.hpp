@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <immintrin.h>
+
+#include "game.hpp"
+
+// 局面の文字列表現。ベンチマークや対局用の局面リストで使用します。
+//
+//   cdldc/...../.hhh./.HHH./...../CDLDC -
+//
+// 盤面は手番側から見て上の行から順に並べて、行の間を/で区切ります。大文字が手番側、小文字が相手側の駒です。
+// 駒はH（ひよこ）、C（ねこ）、D（いぬ）、L（ライオン）、N（にわとり）、P（パワーアップねこ）で表します。
+// 空白の後は持ち駒で、手番側を大文字、相手側を小文字で並べます。持ち駒がない場合は-です。
+// Barium以外のルールでは、盤の大きさと駒の文字はRulesに従います（piece_definitionのcharacter）。
+
+namespace barys {
+  template <typename Rules>
+  inline auto to_string(const basic_state<Rules>& state) {
+    auto result = std::string();
+
+    for (auto i = 0; i < Rules::square_count; ++i) {
+      if (i > 0 && i % Rules::width == 0) {
+        result += '/';
+      }
+
+      auto c = '.';
+
+      for (auto j = 0; j < Rules::piece_count; ++j) {
+        if (state.pieces_on_board()[j] & 1u << i) {
+          c = Rules::pieces[j].character;
+        }
+
+        if (state.enemy_pieces_on_board()[j] & 1u << i) {
+          c = static_cast<char>(Rules::pieces[j].character - 'A' + 'a');
+        }
+      }
+
+      result += c;
+    }
+
+    result += ' ';
+
+    const auto& size = result.size();
+
+    for (auto i = 0; i < Rules::hand_piece_count; ++i) {
+      result.append(state.piece_counts_in_hand()[i], Rules::pieces[i].character);
+    }
+
+    for (auto i = 0; i < Rules::hand_piece_count; ++i) {
+      result.append(state.enemy_piece_counts_in_hand()[i], static_cast<char>(Rules::pieces[i].character - 'A' + 'a'));
+    }
+
+    if (result.size() == size) {
+      result += '-';
+    }
+
+    return result;
+  }
+
+  template <typename Rules = barium_rules>
+  inline auto to_state(const std::string& string) {
+    auto pieces_on_board            = std::array<std::uint32_t, Rules::piece_count>();
+    auto piece_counts_in_hand       = std::array<int,           Rules::hand_piece_count>();
+    auto enemy_pieces_on_board      = std::array<std::uint32_t, Rules::piece_count>();
+    auto enemy_piece_counts_in_hand = std::array<int,           Rules::hand_piece_count>();
+
+    const auto& index = [&](char c) {
+      for (auto i = 0; i < Rules::piece_count; ++i) {
+        if (c == Rules::pieces[i].character || c == Rules::pieces[i].character - 'A' + 'a') {
+          return i;
+        }
+      }
+
+      throw std::invalid_argument("invalid piece '" + std::string(1, c) + "' in \"" + string + "\"");
+    };
+
+    auto it  = std::begin(string);
+    auto bit = 0;
+
+    for (; it != std::end(string) && *it != ' '; ++it) {
+      if (*it == '/') {
+        continue;
+      }
+
+      if (bit >= Rules::square_count) {
+        throw std::invalid_argument("too many squares in \"" + string + "\"");
+      }
+
+      if (*it != '.') {
+        (std::isupper(static_cast<unsigned char>(*it)) ? pieces_on_board : enemy_pieces_on_board)[index(*it)] |= 1u << bit;
+      }
+
+      bit++;
+    }
+
+    if (bit != Rules::square_count) {
+      throw std::invalid_argument("too few squares in \"" + string + "\"");
+    }
+
+    // 探索や評価はライオンが盤上にある前提なので、ライオンがない局面は受け付けません。
+
+    if (_mm_popcnt_u32(pieces_on_board[Rules::king]) != 1 || _mm_popcnt_u32(enemy_pieces_on_board[Rules::king]) != 1) {
+      throw std::invalid_argument("each side must have exactly one " + std::string(Rules::pieces[Rules::king].name) + " on the board in \"" + string + "\"");
+    }
+
+    for (; it != std::end(string); ++it) {
+      if (*it == ' ' || *it == '-') {
+        continue;
+      }
+
+      const auto& i = index(*it);
+
+      if (i >= Rules::hand_piece_count) {
+        throw std::invalid_argument("promoted piece in hand in \"" + string + "\"");
+      }
+
+      if (i == Rules::king) {
+        throw std::invalid_argument(std::string(Rules::pieces[Rules::king].name) + " in hand in \"" + string + "\"");
+      }
+
+      (std::isupper(static_cast<unsigned char>(*it)) ? piece_counts_in_hand : enemy_piece_counts_in_hand)[i]++;
+    }
+
+    return basic_state<Rules>(pieces_on_board, piece_counts_in_hand, enemy_pieces_on_board, enemy_piece_counts_in_hand);
+  }
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/optional.hpp>
+#include <boost/range/algorithm.hpp>
+
+#include "game.hpp"
+#include "move.hpp"
+
+// 定跡。opening-book-builderで、初期局面から数手分の局面を時間をかけて探索しておきます。
+//
+// ファイルは16バイトのヘッダー（"BBK1"、予約、エントリーの数）と、ハッシュ値でソートした16バイトのエントリーの並びです。
+// 1つの局面に複数の手がある場合は、エントリーが連続します。
+
+namespace barys {
+  struct opening_book_entry final {
+    std::uint64_t hash;    // stateのhash()。
+    std::uint16_t move;    // moveのvalue()。
+    std::uint16_t weight;  // 手を選ぶ確率の重み。
+    std::int32_t  score;   // 探索の評価値。
+
+    friend auto operator<(const opening_book_entry& entry_1, const opening_book_entry& entry_2) noexcept {
+      return entry_1.hash < entry_2.hash;
+    }
+  };
+
+  static_assert(sizeof(opening_book_entry) == 16, "opening_book_entry must be 16 bytes");
+
+  class opening_book final {
+    boost::interprocess::file_mapping  _file_mapping;
+    boost::interprocess::mapped_region _mapped_region;
+    const opening_book_entry*          _entries;
+    std::uint64_t                      _size;
+
+  public:
+    static constexpr auto header_size = 16;
+
+    opening_book() noexcept: _file_mapping(), _mapped_region(), _entries(nullptr), _size(0) {
+      ;
+    }
+
+    auto load(const std::string& path) {
+      _file_mapping  = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+      _mapped_region = boost::interprocess::mapped_region(_file_mapping, boost::interprocess::read_only);
+
+      const auto& data = static_cast<const char*>(_mapped_region.get_address());
+
+      if (_mapped_region.get_size() < header_size || std::memcmp(data, "BBK1", 4) != 0) {
+        throw std::runtime_error("invalid opening book " + path);
+      }
+
+      std::memcpy(&_size, data + 8, sizeof(_size));
+
+      if (_mapped_region.get_size() < header_size + _size * sizeof(opening_book_entry)) {
+        throw std::runtime_error("truncated opening book " + path);
+      }
+
+      _entries = reinterpret_cast<const opening_book_entry*>(data + header_size);
+    }
+
+    const auto& size() const noexcept {
+      return _size;
+    }
+
+    // 定跡の手を、重みに比例した確率で選びます。randomは選ぶための乱数です。定跡にない局面では、boost::noneを返します。
+    // マップしたファイルを二分探索するだけなので、メモリーは確保しません。
+
+    auto probe(const state& state, std::uint64_t random) const noexcept {
+      const auto& range = std::equal_range(_entries, _entries + _size, opening_book_entry{state.hash(), 0, 0, 0});
+
+      auto total_weight = std::uint64_t(0);
+
+      for (auto it = range.first; it != range.second; ++it) {
+        total_weight += it->weight;
+      }
+
+      if (total_weight == 0) {
+        return boost::optional<action>();
+      }
+
+      random %= total_weight;
+
+      auto it = range.first;
+
+      for (; random >= it->weight; ++it) {
+        random -= it->weight;
+      }
+
+      const auto& result  = move(it->move).action();
+      const auto& actions = state.actions();
+
+      if (boost::find(actions, result) == std::end(actions)) {  // ハッシュ値の衝突で、合法手ではない手が入っている場合があります。
+        return boost::optional<action>();
+      }
+
+      return boost::make_optional(result);
+    }
+  };
+
+  // 対局で使用する定跡。起動時に、必要ならloadします。
+
+  inline auto& current_opening_book() noexcept {
+    static auto result = opening_book();
+
+    return result;
+  }
+}
@@ -0,0 +1,229 @@
+﻿#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <boost/range/algorithm.hpp>
+
+#include "alpha_beta.hpp"
+#include "game.hpp"
+#include "move.hpp"
+#include "notation.hpp"
+#include "opening_book.hpp"
+#include "position.hpp"
+#include "search_control.hpp"
+#include "transposition_table.hpp"
+
+// 定跡の作成。初期局面から、plies手未満の局面を時間をかけて探索して、最善手を記録します。
+//
+// 先手と後手のどちらを持っても使えるように、初期局面と、初期局面から1手進めた全ての局面から始めます。定跡の手を指した後は、相手がどの手を指しても
+// 定跡から外れないように、相手の全ての手を指した局面を次に探索します。
+//
+// marginを指定した場合は、最善手以外の手も、最善手との評価値の差がmargin以下なら重みを小さくして記録します。他の手は、最善手の探索の深さから1引いた深さで、
+// 手を指した局面を探索して評価します。最善手の探索で置換表に結果が残っているので、それほど時間はかかりません。
+
+namespace {
+  struct book_position final {
+    barys::state state;
+    int ply;
+  };
+
+  // 局面の手を探索して、定跡のエントリーを返します。
+
+  auto search(const barys::state& state, barys::transposition_table& transposition_table, int time_in_ms, int margin) {
+    auto result = std::vector<barys::opening_book_entry>();
+
+    auto search_control = barys::search_control(std::chrono::steady_clock::now() + std::chrono::milliseconds(time_in_ms));
+
+    auto search = barys::alpha_beta(state, search_control, transposition_table);
+    const auto& action = search();
+
+    auto moves = std::vector<barys::move>(barys::move_stack::max_move_count);
+    moves.resize(barys::position(state).generate_moves(moves.data()));
+
+    const auto& best_move  = *boost::find_if(moves, [&](const auto& move) { return move.action() == action; });
+    const auto& best_score = search.best_score();
+
+    result.push_back(barys::opening_book_entry{state.hash(), best_move.value(), static_cast<std::uint16_t>(margin + 1), best_score});
+
+    if (margin == 0 || search.completed_depth() < 2) {
+      return result;
+    }
+
+    for (const auto& move: moves) {
+      if (move == best_move) {
+        continue;
+      }
+
+      const auto& next_state = state.next(move.action());
+
+      auto score = 100000;
+
+      if (!next_state.is_end()) {
+        auto next_search_control = barys::search_control(std::chrono::steady_clock::time_point::max());
+
+        auto next_search = barys::alpha_beta(next_state, next_search_control, transposition_table, 1, search.completed_depth() - 1);
+        next_search();
+
+        score = -next_search.best_score();
+      }
+
+      if (best_score - score <= margin) {
+        result.push_back(barys::opening_book_entry{state.hash(), move.value(), static_cast<std::uint16_t>(margin + 1 - std::max(best_score - score, 0)), score});
+      }
+    }
+
+    return result;
+  }
+}
+
+int main(int argc, char** argv) {
+  auto options = boost::program_options::options_description("options");
+  options.add_options()
+    ("help", "print this message")
+    ("plies", boost::program_options::value<int>()->default_value(3), "store positions up to this many plies from the initial position")
+    ("time", boost::program_options::value<int>()->default_value(10000), "search time per position in milliseconds")
+    ("margin", boost::program_options::value<int>()->default_value(0), "also store moves whose score is within this margin of the best move")
+    ("hash", boost::program_options::value<std::size_t>()->default_value(256), "transposition table size in MB per thread")
+    ("threads", boost::program_options::value<int>()->default_value(static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u))), "number of positions to search in parallel")
+    ("output", boost::program_options::value<std::string>()->default_value("opening_book.bin"), "opening book file to write");
+
+  auto variables = boost::program_options::variables_map();
+
+  try {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), variables);
+    boost::program_options::notify(variables);
+
+  } catch (const boost::program_options::error& e) {
+    std::cerr << e.what() << std::endl << options << std::endl;
+
+    return 1;
+  }
+
+  if (variables.count("help")) {
+    std::cout << options << std::endl;
+
+    return 0;
+  }
+
+  const auto  plies        = variables["plies"].as<int>();
+  const auto  time_in_ms   = variables["time"].as<int>();
+  const auto  margin       = std::max(variables["margin"].as<int>(), 0);
+  const auto  thread_count = std::max(variables["threads"].as<int>(), 1);
+  const auto& path         = variables["output"].as<std::string>();
+
+  try {
+    const auto& starting_time = std::chrono::steady_clock::now();
+
+    // plies毎の、探索する局面。
+
+    auto levels = std::vector<std::vector<book_position>>(std::max(plies, 0));
+    auto hashes = std::unordered_set<std::uint64_t>();
+
+    const auto& add = [&](const barys::state& state, int ply) {
+      if (ply < plies && !state.is_end() && hashes.insert(state.hash()).second) {
+        levels[ply].push_back(book_position{state, ply});
+      }
+    };
+
+    add(barys::state(), 0);
+
+    for (const auto& action: barys::state().actions()) {
+      add(barys::state().next(action), 1);
+    }
+
+    auto entries = std::vector<barys::opening_book_entry>();
+
+    auto transposition_tables = std::vector<std::unique_ptr<barys::transposition_table>>();  // transposition_tableはatomicを持つので、ムーブできません。
+
+    for (auto i = 0; i < thread_count; ++i) {
+      transposition_tables.emplace_back(std::make_unique<barys::transposition_table>(variables["hash"].as<std::size_t>()));
+    }
+
+    for (auto ply = 0; ply < plies; ++ply) {
+      const auto& positions = levels[ply];
+
+      auto next_index = std::atomic<int>(0);
+      auto mutex      = std::mutex();
+
+      const auto& work = [&](int thread_index) {
+        for (auto i = next_index++; i < static_cast<int>(positions.size()); i = next_index++) {
+          const auto& position_entries = search(positions[i].state, *transposition_tables[thread_index], time_in_ms, margin);
+
+          const auto lock = std::lock_guard<std::mutex>(mutex);
+
+          std::cout << "ply " << ply << ", " << i + 1 << " / " << positions.size() << ": " << barys::to_string(positions[i].state) << ", moves = " << position_entries.size() << ", score = " << position_entries.front().score << std::endl;
+
+          entries.insert(std::end(entries), std::begin(position_entries), std::end(position_entries));
+
+          // 定跡の手を指した後の、相手の全ての手。
+
+          for (const auto& entry: position_entries) {
+            const auto& next_state = positions[i].state.next(barys::move(entry.move).action());
+
+            if (next_state.is_end()) {
+              continue;
+            }
+
+            for (const auto& action: next_state.actions()) {
+              add(next_state.next(action), ply + 2);
+            }
+          }
+        }
+      };
+
+      auto threads = std::vector<std::thread>();
+
+      for (auto i = 1; i < thread_count; ++i) {
+        threads.emplace_back(work, i);
+      }
+
+      work(0);
+
+      for (auto& thread: threads) {
+        thread.join();
+      }
+    }
+
+    // 書き出します。同じ局面のエントリーは、重みが大きい順に並べます。
+
+    std::sort(std::begin(entries), std::end(entries), [](const auto& entry_1, const auto& entry_2) {
+      return std::make_pair(entry_1.hash, -static_cast<int>(entry_1.weight)) < std::make_pair(entry_2.hash, -static_cast<int>(entry_2.weight));
+    });
+
+    auto header = std::array<char, barys::opening_book::header_size>{'B', 'B', 'K', '1'};
+    const auto& size = static_cast<std::uint64_t>(entries.size());
+
+    std::memcpy(header.data() + 8, &size, sizeof(size));
+
+    auto stream = std::ofstream(path, std::ios::binary);
+
+    stream.write(header.data(), header.size());
+    stream.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(barys::opening_book_entry));
+
+    if (!stream) {
+      throw std::runtime_error("cannot write " + path);
+    }
+
+    std::cout << "positions = " << hashes.size() << ", entries = " << entries.size() << ", bytes = " << barys::opening_book::header_size + entries.size() * sizeof(barys::opening_book_entry) << ", time = " << std::chrono::duration<double>(std::chrono::steady_clock::now() - starting_time).count() << " s" << std::endl;
+
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+
+    return 1;
+  }
+
+  return 0;
+}
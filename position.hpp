@@ -0,0 +1,501 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "evaluation_weights.hpp"
+#include "game.hpp"
+#include "move.hpp"
+
+namespace barys {
+  // 盤面を反転しながら進めるstateと違って、positionは探索開始時の向きのまま盤面を持ち続けて、手番を記録します。
+  // makeとunmakeでその場で更新するので、局面のコピーもビットの反転も不要です。評価関数の駒とマス目の点数と持ち駒の点数、マス目毎の利きの数も、ここで差分計算します。
+  //
+  // 手（move）のマス目は、stateのactionと同じく手番側から見た向きで扱います。
+
+  template <typename Rules>
+  class basic_position final {
+    using move = basic_move<Rules>;
+
+  public:
+    // マス目毎の利きの数。駒は周囲の8マスにしか利かないので、利きの数は4ビットに収まります。
+    // i番目のバイトの下位4ビットがi番のマス目、上位4ビットがi + 16番のマス目の数で、16バイト全体をSSE2の1命令で足し引きします。
+
+    using square_counts = std::array<std::uint8_t, 16>;
+
+    // unmakeで局面を戻すための情報です。
+
+    class undo final {
+      basic_move<Rules>                        _move;
+      std::int8_t                              _moved_piece;     // 盤上の駒を動かした場合に、動かす前の駒。
+      std::int8_t                              _captured_piece;  // 取った駒。取らなかった場合は-1です。
+      std::array<std::uint64_t, 2>             _hashes;
+      std::array<int, 2>                       _piece_square_scores;
+      alignas(16) std::array<square_counts, 2> _control_counts;
+
+    public:
+      undo(const basic_move<Rules>& move, int moved_piece, int captured_piece, const std::array<std::uint64_t, 2>& hashes, const std::array<int, 2>& piece_square_scores, const std::array<square_counts, 2>& control_counts) noexcept
+        : _move(move), _moved_piece(static_cast<std::int8_t>(moved_piece)), _captured_piece(static_cast<std::int8_t>(captured_piece)), _hashes(hashes), _piece_square_scores(piece_square_scores), _control_counts(control_counts)
+      {
+        ;
+      }
+
+      const auto& move() const noexcept {
+        return _move;
+      }
+
+      auto moved_piece() const noexcept {
+        return static_cast<int>(_moved_piece);
+      }
+
+      auto captured_piece() const noexcept {
+        return static_cast<int>(_captured_piece);
+      }
+
+      const auto& hashes() const noexcept {
+        return _hashes;
+      }
+
+      const auto& piece_square_scores() const noexcept {
+        return _piece_square_scores;
+      }
+
+      const auto& control_counts() const noexcept {
+        return _control_counts;
+      }
+    };
+
+  private:
+    static constexpr auto piece_count = Rules::piece_count;
+
+    // 駒1つ分の利きを、マス目毎の数の形にしたもの。利きがあるマス目が1で、それ以外は0です。
+
+    alignas(16) static constexpr auto control_increments = []() {
+      auto result = std::array<std::array<std::array<square_counts, Rules::square_count>, Rules::piece_count>, 2>();
+
+      for (auto side = 0; side < 2; ++side) {
+        for (auto i = 0; i < Rules::piece_count; ++i) {
+          for (auto bit = 0; bit < Rules::square_count; ++bit) {
+            for (auto j = 0; j < Rules::square_count; ++j) {
+              result[side][i][bit][j % 16] |= (Rules::side_controls[side][i][bit] >> j & 1) << j / 16 * 4;
+            }
+          }
+        }
+      }
+
+      return result;
+    }();
+
+    std::array<std::array<std::uint32_t, Rules::piece_count>,      2> _pieces_on_board;
+    std::array<std::array<int,           Rules::hand_piece_count>, 2> _piece_counts_in_hand;
+    std::array<std::uint32_t, 2>                                     _occupied_bits;
+    std::array<std::int8_t, Rules::square_count>                     _squares;  // マス目毎の駒。手番 * piece_count + piece_typeで、駒がない場合は-1です。
+    std::array<std::uint64_t, 2>                                     _hashes;   // それぞれの手番から見たハッシュ値。stateのhash()と同じ値になります。
+    std::array<int, 2>                                               _piece_square_scores;  // 手番毎の、盤上の駒の点数（evaluation_weightsのpiece_square）の合計。
+    std::array<std::array<int, 2>, 2>                                _hand_scores;          // 手番毎の、持ち駒の序盤と終盤の点数（evaluation_weightsのhand_openingとhand_endgame）の合計。
+    int                                                              _phase;                // ライオン以外の持ち駒の数の合計。
+    alignas(16) std::array<square_counts, 2>                         _control_counts;       // 手番毎の、マス目毎の利きの数。
+    const basic_evaluation_weights<Rules>*                           _weights;
+    int                                                              _side;
+
+    static auto square(int side, int bit) noexcept {
+      return side ? Rules::square_count - 1 - bit : bit;
+    }
+
+    auto piece_square_score(int side, int piece_type, int bit) const noexcept {
+      return _weights->piece_square[piece_type][square(side, bit)];
+    }
+
+    auto toggle_piece(int side, int piece_type, int bit) noexcept {
+      _pieces_on_board[side][piece_type] ^= 1u << bit;
+      _occupied_bits[side]               ^= 1u << bit;
+
+      _hashes[0] ^= Rules::piece_key(side,     piece_type,                          bit);
+      _hashes[1] ^= Rules::piece_key(side ^ 1, piece_type, Rules::square_count - 1 - bit);
+    }
+
+    // 4ビット毎の数は8を超えることも負になることもないので、バイト毎の加算と減算で桁上がりや桁借りは起きません。
+
+    auto add_controls(int side, int piece_type, int bit) noexcept {
+      const auto& counts = reinterpret_cast<__m128i*>(_control_counts[side].data());
+
+      _mm_store_si128(counts, _mm_add_epi8(_mm_load_si128(counts), _mm_load_si128(reinterpret_cast<const __m128i*>(control_increments[side][piece_type][bit].data()))));
+    }
+
+    auto subtract_controls(int side, int piece_type, int bit) noexcept {
+      const auto& counts = reinterpret_cast<__m128i*>(_control_counts[side].data());
+
+      _mm_store_si128(counts, _mm_sub_epi8(_mm_load_si128(counts), _mm_load_si128(reinterpret_cast<const __m128i*>(control_increments[side][piece_type][bit].data()))));
+    }
+
+    auto put_piece(int side, int piece_type, int bit) noexcept {
+      toggle_piece(side, piece_type, bit);
+
+      _piece_square_scores[side] += piece_square_score(side, piece_type, bit);
+
+      add_controls(side, piece_type, bit);
+    }
+
+    auto remove_piece(int side, int piece_type, int bit) noexcept {
+      toggle_piece(side, piece_type, bit);
+
+      _piece_square_scores[side] -= piece_square_score(side, piece_type, bit);
+
+      subtract_controls(side, piece_type, bit);
+    }
+
+    // 持ち駒の点数に、count個分を足します。ライオンは持ち駒として使えないので、点数はありません。
+
+    auto add_hand_score(int side, int piece_type, int count) noexcept {
+      if (piece_type == Rules::king) {
+        return;
+      }
+
+      _hand_scores[side][0] += count * _weights->hand_opening[piece_type];
+      _hand_scores[side][1] += count * _weights->hand_endgame[piece_type];
+      _phase                += count;
+    }
+
+    auto set_piece_count_in_hand(int side, int piece_type, int count) noexcept {
+      auto& piece_count_in_hand = _piece_counts_in_hand[side][piece_type];
+
+      _hashes[0] ^= Rules::hand_key(side,     piece_type, piece_count_in_hand) ^ Rules::hand_key(side,     piece_type, count);
+      _hashes[1] ^= Rules::hand_key(side ^ 1, piece_type, piece_count_in_hand) ^ Rules::hand_key(side ^ 1, piece_type, count);
+
+      add_hand_score(side, piece_type, count - piece_count_in_hand);
+
+      piece_count_in_hand = count;
+    }
+
+  public:
+    basic_position(const basic_state<Rules>& state, const basic_evaluation_weights<Rules>& weights = current_evaluation_weights<Rules>()) noexcept
+      : _pieces_on_board{state.pieces_on_board(), state.enemy_pieces_on_board()}, _piece_counts_in_hand{state.piece_counts_in_hand(), state.enemy_piece_counts_in_hand()}, _occupied_bits(), _squares(), _hashes{state.hash(), state.reversed_hash()}, _piece_square_scores(), _hand_scores(), _phase(0), _control_counts(), _weights(&weights), _side(0)
+    {
+      _squares.fill(-1);
+
+      for (auto side = 0; side < 2; ++side) {
+        for (auto i = 0; i < Rules::hand_piece_count; ++i) {
+          add_hand_score(side, i, _piece_counts_in_hand[side][i]);
+        }
+
+        for (auto i = 0; i < piece_count; ++i) {
+          _occupied_bits[side] |= _pieces_on_board[side][i];
+
+          for (auto piece_bits = _pieces_on_board[side][i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+            _squares[_tzcnt_u32(piece_bits)] = static_cast<std::int8_t>(side * piece_count + i);
+
+            _piece_square_scores[side] += piece_square_score(side, i, _tzcnt_u32(piece_bits));
+
+            add_controls(side, i, _tzcnt_u32(piece_bits));
+          }
+        }
+      }
+    }
+
+    const auto& pieces_on_board(int side) const noexcept {
+      return _pieces_on_board[side];
+    }
+
+    const auto& piece_counts_in_hand(int side) const noexcept {
+      return _piece_counts_in_hand[side];
+    }
+
+    const auto& side() const noexcept {
+      return _side;
+    }
+
+    const auto& hash() const noexcept {
+      return _hashes[_side];
+    }
+
+    const auto& piece_square_score(int side) const noexcept {
+      return _piece_square_scores[side];
+    }
+
+    // sideの持ち駒の、序盤と終盤の点数です。
+
+    const auto& hand_score(int side) const noexcept {
+      return _hand_scores[side];
+    }
+
+    const auto& phase() const noexcept {
+      return _phase;
+    }
+
+    const auto& weights() const noexcept {
+      return *_weights;
+    }
+
+    auto is_end() const noexcept {
+      return _piece_counts_in_hand[_side ^ 1][Rules::king] != 0;
+    }
+
+    // sideの駒の利きがあるマス目のビット。利きの数が0ではないマス目です。
+
+    auto controlled_bits(int side) const noexcept {
+      const auto& counts   = _mm_load_si128(reinterpret_cast<const __m128i*>(_control_counts[side].data()));
+      const auto& low_mask = _mm_set1_epi8(0x0f);
+      const auto& zero     = _mm_setzero_si128();
+
+      const auto& low_bits  = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(counts, low_mask), zero)));
+      const auto& high_bits = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_srli_epi16(counts, 4), low_mask), zero)));
+
+      return ~(low_bits | high_bits << 16);
+    }
+
+    // bitのマス目に利いているsideの駒のビット。1（後手）の利きは0（先手）の利きを回転させたものなので、bitから反対側の利きを調べれば十分です。
+
+    auto attacker_bits(int side, int bit) const noexcept {
+      auto result = 0u;
+
+      for (auto i = 0; i < piece_count; ++i) {
+        result |= Rules::side_controls[side ^ 1][i][bit] & _pieces_on_board[side][i];
+      }
+
+      return result;
+    }
+
+    // 手番側のライオンに相手の駒の利きがあるならtrueを返します。
+
+    auto is_checked() const noexcept {
+      const auto& lion_bits = _pieces_on_board[_side][Rules::king];
+
+      return lion_bits && attacker_bits(_side ^ 1, _tzcnt_u32(lion_bits));
+    }
+
+    // 手番側から見た向きのマス目にある相手の駒の種類。駒がない場合は-1です。
+
+    auto enemy_piece_type_at(int bit) const noexcept {
+      const auto& piece = _squares[square(_side, bit)];
+
+      return piece >= 0 && piece / piece_count != _side ? piece % piece_count : -1;
+    }
+
+    // 手番側から見た向きのマス目にある手番側の駒の種類。駒がない場合は-1です。
+
+    auto piece_type_at(int bit) const noexcept {
+      const auto& piece = _squares[square(_side, bit)];
+
+      return piece >= 0 && piece / piece_count == _side ? piece % piece_count : -1;
+    }
+
+  private:
+    // 相手のライオンの前のマス目（to）にひよこを打つと詰みになるならtrueを返します。stateのis_chick_drop_mateと同じ判定を、盤面の向きを変えずに行います。
+
+    auto is_chick_drop_mate(int to) const noexcept {
+      const auto& lion_bits = _pieces_on_board[_side][Rules::king];
+
+      if (lion_bits && attacker_bits(_side ^ 1, _tzcnt_u32(lion_bits))) {  // 相手が手番側のライオンを取れる。
+        return false;
+      }
+
+      const auto& enemy_lion_bits = _pieces_on_board[_side ^ 1][Rules::king];
+      const auto& controlled_bits = basic_position::controlled_bits(_side);
+
+      if (Rules::side_controls[_side ^ 1][Rules::king][_tzcnt_u32(enemy_lion_bits)] & ~_occupied_bits[_side ^ 1] & ~controlled_bits) {  // ライオンが逃げられる。打ったひよこを取る場合も含みます。
+        return false;
+      }
+
+      if (!(controlled_bits & enemy_lion_bits) && attacker_bits(_side ^ 1, to) & ~enemy_lion_bits) {  // ライオン以外の駒でひよこを取れば、ライオンに利きがなくなる。
+        return false;
+      }
+
+      return true;
+    }
+
+    auto chick_allowed_bits() const noexcept {
+      auto result = 0u;
+
+      const auto& chick_bits = _pieces_on_board[_side][0];
+
+      for (auto i = Rules::width; i < Rules::square_count; i += Rules::width) {  // ひよこの後と前はダメ。
+        result |= chick_bits << i | chick_bits >> i;
+      }
+
+      const auto& enemy_lion_bits = _pieces_on_board[_side ^ 1][Rules::king];
+
+      result |= _side == 0 ? Rules::top_row_bits : Rules::bottom_row_bits;  // 一番上の行は行き場所がなくなるのでダメ。
+
+      const auto& lion_front_bits = (_side == 0 ? enemy_lion_bits << Rules::width : enemy_lion_bits >> Rules::width) & Rules::board_bits & ~(_occupied_bits[0] | _occupied_bits[1]) & ~result;
+
+      if (lion_front_bits && is_chick_drop_mate(_tzcnt_u32(lion_front_bits))) {  // 「打ちひよこ詰め」はダメ。
+        result |= lion_front_bits;
+      }
+
+      return ~result;
+    }
+
+  public:
+    // 合法手をresultに書き込んで、書き込んだ手の数を返します。resultにはbasic_move_stack::max_move_count手分の領域が必要です。
+
+    __forceinline auto generate_moves(move* result) const noexcept {
+      auto it = result;
+
+      // moves.
+
+      const auto& controls       = Rules::side_controls[_side];
+      const auto& vacant_bits    = ~_occupied_bits[_side];
+      const auto& promotion_bits = _side == 0 ? Rules::promotion_bits : Rules::reversed_promotion_bits;
+
+      for (auto i = 0; i < piece_count; ++i) {
+        const auto& is_promotable = Rules::is_promotable(i);
+
+        for (auto piece_bits = _pieces_on_board[_side][i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          const auto& from = static_cast<int>(_tzcnt_u32(piece_bits));
+
+          for (auto control_bits = controls[i][from] & vacant_bits; control_bits; control_bits = _blsr_u32(control_bits)) {
+            const auto& to = static_cast<int>(_tzcnt_u32(control_bits));
+
+            *it++ = move(square(_side, from), square(_side, to), is_promotable && promotion_bits & 1u << to);
+          }
+        }
+      }
+
+      // drops.
+
+      const auto& empty_bits = Rules::board_bits & ~(_occupied_bits[0] | _occupied_bits[1]);
+
+      if (_piece_counts_in_hand[_side][0]) {
+        for (auto to_bits = empty_bits & (Rules::is_chick_drop_restricted ? chick_allowed_bits() : ~0u); to_bits; to_bits = _blsr_u32(to_bits)) {
+          *it++ = move(Rules::square_count, square(_side, _tzcnt_u32(to_bits)), false);
+        }
+      }
+
+      for (auto i = 1; i < Rules::king; ++i) {
+        if (_piece_counts_in_hand[_side][i]) {
+          for (auto to_bits = empty_bits; to_bits; to_bits = _blsr_u32(to_bits)) {
+            *it++ = move(Rules::square_count + i, square(_side, _tzcnt_u32(to_bits)), false);
+          }
+        }
+      }
+
+      return static_cast<int>(it - result);
+    }
+
+    // 駒を取る手と成る手だけを生成します。静止探索で使用します。
+
+    __forceinline auto generate_capture_moves(move* result) const noexcept {
+      auto it = result;
+
+      const auto& controls       = Rules::side_controls[_side];
+      const auto& vacant_bits    = ~_occupied_bits[_side];
+      const auto& promotion_bits = _side == 0 ? Rules::promotion_bits : Rules::reversed_promotion_bits;
+
+      for (auto i = 0; i < piece_count; ++i) {
+        const auto& is_promotable = Rules::is_promotable(i);
+        const auto& target_bits   = _occupied_bits[_side ^ 1] | (is_promotable ? promotion_bits : 0);
+
+        for (auto piece_bits = _pieces_on_board[_side][i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+          const auto& from = static_cast<int>(_tzcnt_u32(piece_bits));
+
+          for (auto control_bits = controls[i][from] & vacant_bits & target_bits; control_bits; control_bits = _blsr_u32(control_bits)) {
+            const auto& to = static_cast<int>(_tzcnt_u32(control_bits));
+
+            *it++ = move(square(_side, from), square(_side, to), is_promotable && promotion_bits & 1u << to);
+          }
+        }
+      }
+
+      return static_cast<int>(it - result);
+    }
+
+    __forceinline auto make(const move& move) noexcept {
+      const auto  side   = _side;
+      const auto& to     = square(side, move.to());
+      const auto& hashes = std::array<std::uint64_t, 2>(_hashes);
+      const auto& scores = std::array<int, 2>(_piece_square_scores);
+      const auto& counts = std::array<square_counts, 2>(_control_counts);
+
+      if (!move.is_drop()) {
+        const auto& from           = square(side, move.from());
+        const auto& moved_piece    = static_cast<int>(_squares[from]);
+        const auto& captured_piece = static_cast<int>(_squares[to]);
+
+        if (captured_piece >= 0) {
+          const auto& hand_index = Rules::demoted_pieces[captured_piece % piece_count];
+
+          remove_piece(side ^ 1, captured_piece % piece_count, to);
+          set_piece_count_in_hand(side, hand_index, _piece_counts_in_hand[side][hand_index] + 1);
+        }
+
+        const auto& to_piece_type = move.is_promotion() ? Rules::promoted_pieces[moved_piece % piece_count] : moved_piece % piece_count;
+
+        remove_piece(side, moved_piece % piece_count, from);
+        put_piece(side, to_piece_type, to);
+
+        _squares[from] = -1;
+        _squares[to]   = static_cast<std::int8_t>(side * piece_count + to_piece_type);
+
+        _side ^= 1;
+
+        return undo(move, moved_piece, captured_piece, hashes, scores, counts);
+      }
+
+      set_piece_count_in_hand(side, move.from_hand(), _piece_counts_in_hand[side][move.from_hand()] - 1);
+      put_piece(side, move.from_hand(), to);
+
+      _squares[to] = static_cast<std::int8_t>(side * piece_count + move.from_hand());
+
+      _side ^= 1;
+
+      return undo(move, -1, -1, hashes, scores, counts);
+    }
+
+    // パス（null move）。ハッシュ値は手番側から見た値なので、手番を入れ替えるだけで済みます。
+
+    auto make_null() noexcept {
+      _side ^= 1;
+    }
+
+    auto unmake_null() noexcept {
+      _side ^= 1;
+    }
+
+    __forceinline auto unmake(const undo& undo) noexcept {
+      _side ^= 1;
+
+      const auto  side = _side;
+      const auto& move = undo.move();
+      const auto& to   = square(side, move.to());
+
+      if (!move.is_drop()) {
+        const auto& from = square(side, move.from());
+
+        _pieces_on_board[side][_squares[to] % piece_count] ^= 1u << to;
+        _pieces_on_board[side][undo.moved_piece() % piece_count] ^= 1u << from;
+        _occupied_bits[side] ^= 1u << to | 1u << from;
+
+        _squares[from] = static_cast<std::int8_t>(undo.moved_piece());
+        _squares[to]   = static_cast<std::int8_t>(undo.captured_piece());
+
+        if (undo.captured_piece() >= 0) {
+          _pieces_on_board[side ^ 1][undo.captured_piece() % piece_count] ^= 1u << to;
+          _occupied_bits[side ^ 1] ^= 1u << to;
+
+          _piece_counts_in_hand[side][Rules::demoted_pieces[undo.captured_piece() % piece_count]]--;
+
+          add_hand_score(side, Rules::demoted_pieces[undo.captured_piece() % piece_count], -1);
+        }
+
+      } else {
+        _pieces_on_board[side][move.from_hand()] ^= 1u << to;
+        _occupied_bits[side] ^= 1u << to;
+
+        _squares[to] = -1;
+
+        _piece_counts_in_hand[side][move.from_hand()]++;
+
+        add_hand_score(side, move.from_hand(), 1);
+      }
+
+      _hashes              = undo.hashes();
+      _piece_square_scores = undo.piece_square_scores();
+      _control_counts      = undo.control_counts();
+    }
+  };
+
+  using position = basic_position<barium_rules>;
+}
@@ -0,0 +1,270 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+
+// ゲームのルール。盤の大きさ、駒の種類と動き、成れる範囲を、コンパイル時の定数として持ちます。
+//
+// ルールはバリアント（barium_variantのような、定数だけを持つ構造体）で定義して、basic_rules<バリアント>が利きやZobristハッシュのキーなどの表をコンパイル時に生成します。
+// state、position、alpha_betaなどはルールをテンプレート引数に取るので、バリアント毎に専用のコードが生成されます。いつものゲームは、barium_rulesです。
+//
+// 盤のマス目は、手番側から見て上の行から順に0、1、2……と番号を付けます（ビットボードのビットの位置です）。上が相手側なので、前に進むと番号が小さくなります。
+// 駒の種類は、持ち駒になる駒、玉（ライオン）、成った駒の順に並べてください。持ち駒の配列は玉までで、玉の持ち駒は玉を取ったこと（ゲームの終了）を表します。
+// 0番の駒はひよこ（歩）として扱って、is_chick_drop_restrictedがtrueなら、二歩、行き場所のないマス目、打ちひよこ詰めに打つ手を禁止します。
+
+namespace barys {
+  // 駒が動ける方向。駒の動きは全て、周囲の1マスです。
+
+  struct direction final {
+    static constexpr std::uint8_t front_left  = 1 << 0;
+    static constexpr std::uint8_t front       = 1 << 1;
+    static constexpr std::uint8_t front_right = 1 << 2;
+    static constexpr std::uint8_t left        = 1 << 3;
+    static constexpr std::uint8_t right       = 1 << 4;
+    static constexpr std::uint8_t back_left   = 1 << 5;
+    static constexpr std::uint8_t back        = 1 << 6;
+    static constexpr std::uint8_t back_right  = 1 << 7;
+  };
+
+  struct piece_definition final {
+    const char*  name;           // 評価関数の重みのファイルで使う名前。
+    char         character;      // 局面の文字列表現で使う文字（大文字）。
+    std::uint8_t directions;
+    int          promoted;       // 成った駒の種類。成らない駒は自分自身です。
+    int          value;          // 駒の点数。評価関数の重みの既定値に使います。玉は0です。
+    int          capture_order;  // 手の並べ替え（MVV-LVA）で使う、駒の価値の順番。
+  };
+
+  // Bariumで使う、5×6の盤のどうぶつしょうぎ。ねこは成るとパワーアップねこになります。
+
+  struct barium_variant {
+    static constexpr auto width               = 5;
+    static constexpr auto height              = 6;
+    static constexpr auto promotion_row_count = 2;  // 相手側の2行に入ると成ります。
+    static constexpr auto king                = 3;
+
+    static constexpr auto is_chick_drop_restricted = true;
+
+    static constexpr std::array<piece_definition, 6> pieces = {{
+      {"chick",        'H', direction::front,                                                                                                                      4,  100,  1},
+      {"cat",          'C', direction::front_left | direction::front | direction::front_right | direction::back_left | direction::back_right,                      5, 1000,  2},
+      {"dog",          'D', direction::front_left | direction::front | direction::front_right | direction::left | direction::right | direction::back,              2, 1200,  3},
+      {"lion",         'L', direction::front_left | direction::front | direction::front_right | direction::left | direction::right | direction::back_left | direction::back | direction::back_right, 3, 0, 10},
+      {"chicken",      'N', direction::front_left | direction::front | direction::front_right | direction::left | direction::right | direction::back,              4, 1200,  3},
+      {"power_up_cat", 'P', direction::front_left | direction::front | direction::front_right | direction::left | direction::right | direction::back,              5, 1200,  3}
+    }};
+
+    static constexpr auto max_action_count = 4 * 3 + 14 * 5 + 12 * 8 + 1 * 25 + 2 * 28;  // 1局面の合法手の数の上限。
+
+    static constexpr std::array<std::uint32_t, 6> initial_pieces       = {0b00000000000001110000000000000000,
+                                                                          0b00100010000000000000000000000000,
+                                                                          0b00010100000000000000000000000000,
+                                                                          0b00001000000000000000000000000000,
+                                                                          0b00000000000000000000000000000000,
+                                                                          0b00000000000000000000000000000000};
+
+    static constexpr std::array<std::uint32_t, 6> initial_enemy_pieces = {0b00000000000000000011100000000000,
+                                                                          0b00000000000000000000000000010001,
+                                                                          0b00000000000000000000000000001010,
+                                                                          0b00000000000000000000000000000100,
+                                                                          0b00000000000000000000000000000000,
+                                                                          0b00000000000000000000000000000000};
+  };
+
+  // トライのないどうぶつしょうぎ（3×4）。トライ（ライオンが相手側の行に入って勝つルール）を実装していないので、元のどうぶつしょうぎとは違って、ライオンを取られるまで続けます。ひよこを打つ場所の制限はありません。
+
+  struct dobutsu_variant {
+    static constexpr auto width               = 3;
+    static constexpr auto height              = 4;
+    static constexpr auto promotion_row_count = 1;
+    static constexpr auto king                = 3;
+
+    static constexpr auto is_chick_drop_restricted = false;
+
+    static constexpr std::array<piece_definition, 5> pieces = {{
+      {"chick",    'H', direction::front,                                                                                                                      4,  100,  1},
+      {"giraffe",  'G', direction::front | direction::left | direction::right | direction::back,                                                               1, 1000,  2},
+      {"elephant", 'E', direction::front_left | direction::front_right | direction::back_left | direction::back_right,                                          2, 1000,  2},
+      {"lion",     'L', direction::front_left | direction::front | direction::front_right | direction::left | direction::right | direction::back_left | direction::back | direction::back_right, 3, 0, 10},
+      {"hen",      'N', direction::front_left | direction::front | direction::front_right | direction::left | direction::right | direction::back,              4, 1200,  3}
+    }};
+
+    static constexpr auto max_action_count = 7 * 8 + 3 * 12;  // 盤上の自分の駒は、相手のライオン以外の7つまでで、1つ8方向まで。持ち駒は3種類で、それぞれ12マスまで。
+
+    static constexpr std::array<std::uint32_t, 5> initial_pieces       = {0b000010000000,
+                                                                          0b100000000000,
+                                                                          0b001000000000,
+                                                                          0b010000000000,
+                                                                          0b000000000000};
+
+    static constexpr std::array<std::uint32_t, 5> initial_enemy_pieces = {0b000000010000,
+                                                                          0b000000000001,
+                                                                          0b000000000100,
+                                                                          0b000000000010,
+                                                                          0b000000000000};
+  };
+
+  // バリアントから、探索で使う表を生成します。
+
+  template <typename Variant>
+  struct basic_rules final: Variant {
+    static constexpr auto square_count     = Variant::width * Variant::height;
+    static constexpr auto piece_count      = static_cast<int>(Variant::pieces.size());
+    static constexpr auto hand_piece_count = Variant::king + 1;  // 持ち駒の種類の数。最後は玉です。
+
+    static_assert(square_count <= 32, "the board must fit in 32 bits");
+    static_assert(Variant::king < piece_count, "the king must be in the pieces");
+
+    static constexpr std::uint32_t board_bits      = square_count == 32 ? ~0u : (1u << square_count) - 1;
+    static constexpr std::uint32_t top_row_bits    = (1u << Variant::width) - 1;
+    static constexpr std::uint32_t bottom_row_bits = top_row_bits << (square_count - Variant::width);
+
+    // 成れるマス目。reversed_promotion_bitsは、180度回転させたもの（相手が成れるマス目）です。
+
+    static constexpr std::uint32_t promotion_bits          = (1u << Variant::width * Variant::promotion_row_count) - 1;
+    static constexpr std::uint32_t reversed_promotion_bits = promotion_bits << (square_count - Variant::width * Variant::promotion_row_count);
+
+    // 両方の駒の数の合計。駒は取られても持ち駒になるだけなので、増えも減りもしません。
+
+    static constexpr auto count_pieces() noexcept {
+      auto result = 0;
+
+      for (auto i = 0; i < piece_count; ++i) {
+        for (auto bit = 0; bit < square_count; ++bit) {
+          result += (Variant::initial_pieces[i] >> bit & 1) + (Variant::initial_enemy_pieces[i] >> bit & 1);
+        }
+      }
+
+      return result;
+    }
+
+    static constexpr auto total_piece_count = count_pieces();
+
+    static constexpr auto promoted_piece_types() noexcept {
+      auto result = std::array<int, piece_count>();
+
+      for (auto i = 0; i < piece_count; ++i) {
+        result[i] = Variant::pieces[i].promoted;
+      }
+
+      return result;
+    }
+
+    static constexpr auto demoted_piece_types() noexcept {
+      auto result = std::array<int, piece_count>();
+
+      for (auto i = 0; i < piece_count; ++i) {
+        result[i] = i;
+      }
+
+      for (auto i = 0; i < piece_count; ++i) {
+        if (Variant::pieces[i].promoted != i) {
+          result[Variant::pieces[i].promoted] = i;
+        }
+      }
+
+      return result;
+    }
+
+    static constexpr auto promoted_pieces = promoted_piece_types();
+    static constexpr auto demoted_pieces  = demoted_piece_types();
+
+    static constexpr auto is_promotable(int piece_type) noexcept {
+      return promoted_pieces[piece_type] != piece_type;
+    }
+
+    // 手番毎の駒の利き。1（相手側）の駒の利きは、0（手番側）の利きを180度回転させたものです。
+
+    static constexpr auto make_side_controls() noexcept {
+      constexpr int offsets[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};  // directionのビットの順です。
+
+      auto result = std::array<std::array<std::array<std::uint32_t, square_count>, piece_count>, 2>();
+
+      for (auto i = 0; i < piece_count; ++i) {
+        for (auto bit = 0; bit < square_count; ++bit) {
+          for (auto j = 0; j < 8; ++j) {
+            if (!(Variant::pieces[i].directions >> j & 1)) {
+              continue;
+            }
+
+            const auto x = bit % Variant::width  + offsets[j][0];
+            const auto y = bit / Variant::width  + offsets[j][1];
+
+            if (x < 0 || x >= Variant::width || y < 0 || y >= Variant::height) {
+              continue;
+            }
+
+            result[0][i][bit]                    |= 1u << (y * Variant::width + x);
+            result[1][i][square_count - 1 - bit] |= 1u << (square_count - 1 - (y * Variant::width + x));
+          }
+        }
+      }
+
+      return result;
+    }
+
+    static constexpr auto side_controls = make_side_controls();
+
+    // Zobristハッシュのキー。sideは手番側が0、相手側が1です。splitmix64で生成します。持ち駒は1種類8枚までです。
+
+    static constexpr auto max_hand_count = 8;
+
+    static constexpr auto make_zobrist_keys() noexcept {
+      constexpr auto piece_key_count = 2 * piece_count * square_count;
+
+      auto result = std::array<std::uint64_t, piece_key_count + 2 * hand_piece_count * max_hand_count>();
+      auto seed   = std::uint64_t(0x9e3779b97f4a7c15);
+
+      for (auto i = 0; i < static_cast<int>(result.size()); ++i) {
+        if (i >= piece_key_count && (i - piece_key_count) % max_hand_count == 0) {  // 持ち駒が0枚の場合のキーは0にしておきます。
+          continue;
+        }
+
+        auto key = (seed += 0x9e3779b97f4a7c15);
+
+        key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9;
+        key = (key ^ (key >> 27)) * 0x94d049bb133111eb;
+
+        result[i] = key ^ (key >> 31);
+      }
+
+      return result;
+    }
+
+    static constexpr auto zobrist_keys = make_zobrist_keys();
+
+    static auto piece_key(int side, int piece_type, int bit) noexcept {
+      return zobrist_keys[(side * piece_count + piece_type) * square_count + bit];
+    }
+
+    static auto hand_key(int side, int piece_type, int count) noexcept {
+      return zobrist_keys[2 * piece_count * square_count + (side * hand_piece_count + piece_type) * max_hand_count + count];
+    }
+
+    // 盤面を180度回転します。32ビット全体を反転してから、盤の外の分をずらします。
+
+    static auto reverse(std::uint32_t piece_bits) noexcept {
+      static constexpr auto reversed = []() {
+        auto result = std::array<std::uint8_t, 256>();
+
+        for (auto i = 0; i < 256; ++i) {
+          for (auto j = 0; j < 8; ++j) {
+            result[i] |= (i >> j & 1) << (7 - j);
+          }
+        }
+
+        return result;
+      }();
+
+      piece_bits <<= 32 - square_count;
+
+      return (static_cast<std::uint32_t>(reversed[piece_bits       & 0x000000ff]) << 24 |
+              static_cast<std::uint32_t>(reversed[piece_bits >>  8 & 0x000000ff]) << 16 |
+              static_cast<std::uint32_t>(reversed[piece_bits >> 16 & 0x000000ff]) <<  8 |
+              static_cast<std::uint32_t>(reversed[piece_bits >> 24             ]));
+    }
+  };
+
+  using barium_rules  = basic_rules<barium_variant>;
+  using dobutsu_rules = basic_rules<dobutsu_variant>;
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace barys {
+  // 探索の制御。制限時間と停止フラグを、全ての探索スレッドで共有します。先読み（ponder）が当たった場合は、探索中に制限時間を設定し直します。
+  // 時計を読むのは遅いので、探索スレッドはcheck_intervalノード毎にだけcheckを呼び出します。時計は、時刻合わせの影響を受けないsteady_clockを使用します。
+
+  class search_control final {
+    std::atomic<std::chrono::steady_clock::time_point> _time_limit;
+    std::atomic<bool>                                  _is_stopped;
+
+  public:
+    static constexpr auto check_interval = 1024;
+
+    search_control(const std::chrono::steady_clock::time_point& time_limit) noexcept: _time_limit(time_limit), _is_stopped(false) {
+      ;
+    }
+
+    auto time_limit() const noexcept {
+      return _time_limit.load(std::memory_order_relaxed);
+    }
+
+    // 制限時間を変更します。他のスレッドから呼び出しても構いません。
+
+    auto set_time_limit(const std::chrono::steady_clock::time_point& time_limit) noexcept {
+      _time_limit.store(time_limit, std::memory_order_relaxed);
+    }
+
+    // 探索を止めます。他のスレッドから呼び出しても構いません。
+
+    auto stop() noexcept {
+      _is_stopped.store(true, std::memory_order_relaxed);
+    }
+
+    auto is_stopped() const noexcept {
+      return _is_stopped.load(std::memory_order_relaxed);
+    }
+
+    // 探索を止めるべきならtrueを返します。時間切れの場合は、他のスレッドもすぐに止まるように停止フラグを立てます。
+
+    auto check() noexcept {
+      if (is_stopped()) {
+        return true;
+      }
+
+      if (std::chrono::steady_clock::now() >= time_limit()) {
+        stop();
+
+        return true;
+      }
+
+      return false;
+    }
+
+    // 時計を1回読むのにかかる時間です。checkのオーバーヘッドの見積もりに使用します。
+
+    static auto clock_read_time() noexcept {
+      static const auto result = []() {
+        const auto& starting_time = std::chrono::steady_clock::now();
+
+        for (auto i = 0; i < 1024; ++i) {
+          std::chrono::steady_clock::now();
+        }
+
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - starting_time).count() / 1025;
+      }();
+
+      return result;
+    }
+  };
+}
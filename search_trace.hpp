@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "game.hpp"
+
+// 探索の記録。なぜ時間がかかったのか、なぜ悪い手を指したのかを後から調べるために、反復毎の値やβカットした手の順番を記録します。
+//
+// 記録はBARYS_SEARCH_TRACEを定義してビルドした場合だけです（MSVCなら/DBARYS_SEARCH_TRACE）。定義しない場合は記録のコードがなくなるので、探索の速度は変わりません。
+// bridgeは、1手毎に1行のJSON（JSON Lines）で書き出します。
+
+#ifdef BARYS_SEARCH_TRACE
+
+namespace barys {
+  // 完了した反復の記録です。ノード数などは、メイン・スレッドの、その反復の分だけです。
+
+  struct iteration_trace final {
+    int                                 depth;
+    int                                 score;
+    std::uint64_t                       node_count;
+    std::uint64_t                       quiescence_node_count;
+    std::uint64_t                       probe_count;
+    std::uint64_t                       hit_count;
+    std::chrono::steady_clock::duration time;
+    std::vector<action>                 principal_variation;  // その反復の最善手から、置換表を辿って取り出した読み筋です。
+  };
+
+  // 反復深化をやめた理由。
+
+  enum class stop_reason: int {depth_limit, single_move, decided, tablebase, time_estimate, timeout};
+
+  inline auto to_string(stop_reason stop_reason) noexcept {
+    static constexpr const char* names[] = {"depth_limit", "single_move", "decided", "tablebase", "time_estimate", "timeout"};
+
+    return names[static_cast<int>(stop_reason)];
+  }
+
+  struct search_trace final {
+    static constexpr auto cutoff_index_count = 16;
+
+    std::vector<iteration_trace>                   iterations;
+    std::array<std::uint64_t, cutoff_index_count> cutoff_indices;  // βカットした手が何番目だったかの分布（全てのスレッドの合計）。最後の要素は、それ以降の全てです。
+    barys::stop_reason                             stop_reason;
+
+    // 時間切れで打ち切った反復。stop_reasonがtimeoutの場合だけ意味があります。
+
+    int                                 abort_depth;
+    std::uint64_t                       abort_node_count;
+    std::chrono::steady_clock::duration abort_time;  // 探索を開始してから打ち切るまでの時間です。
+  };
+}
+
+#endif
@@ -0,0 +1,370 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <immintrin.h>
+#include <nmmintrin.h>
+
+#include <boost/container/static_vector.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/optional.hpp>
+
+#include "game.hpp"
+#include "position.hpp"
+
+// 終盤データベース。ライオン以外の駒が少ない局面を、tablebase-generatorで後退解析して全部解いておきます。
+//
+// 取った駒は持ち駒になるので、対局中に駒の数は減りません。ライオン以外の駒の種類と数（ひよこ、ねこ、いぬの数。成った駒は成る前の駒として数えます）毎に
+// ファイルを分けて、探索開始時の局面と同じ駒の組み合わせのファイルがあれば、探索中は常にそのファイルを引きます。
+//
+// ファイルは16バイトのヘッダー（"BTB1"、ひよこ、ねこ、いぬの数、予約、局面数）と、局面毎の1バイトの値です。値はライオンを取るまでの手数で、
+// 奇数なら手番側の勝ち、偶数なら手番側の負け、0なら引き分け（どちらもライオンを取れない）か、ありえない局面です。
+
+namespace barys {
+  // 終盤データベースの局面。手番側から見た向きで、ライオンのマス目と、ライオン以外の駒の種類（成る前）とスロットを持ちます。
+  // スロットは、盤上なら手番側か相手側か、成っているか、マス目を、持ち駒ならどちらの持ち駒かを表します。駒は種類、スロットの順に並べます。
+
+  struct tablebase_position final {
+    static constexpr auto max_piece_count = 3;
+
+    int lion;
+    int enemy_lion;
+    boost::container::static_vector<std::pair<int, int>, max_piece_count> pieces;
+
+    auto sort() noexcept {
+      std::sort(std::begin(pieces), std::end(pieces));
+    }
+  };
+
+  class tablebase final {
+  public:
+    static constexpr auto square_count     = barium_rules::square_count;
+    static constexpr auto piece_type_count = barium_rules::hand_piece_count - 1;  // 駒の組み合わせに数える駒の種類の数。ライオン以外の持ち駒になる駒（ひよこ、ねこ、いぬ）です。
+
+    using signature = std::array<int, piece_type_count>;  // 駒の組み合わせ。ひよこ、ねこ、いぬの数です。
+
+    static constexpr auto header_size = 16;
+
+    // スロット。ひよことねこは(成っているか * 2 + 相手側か) * square_count + マス目で、いぬは相手側か * square_count + マス目です。その後ろが手番側と相手側の持ち駒です。
+
+    static auto is_promotable(int piece_type) noexcept {
+      return barium_rules::is_promotable(piece_type);
+    }
+
+    static auto slot_count(int piece_type) noexcept {
+      return (is_promotable(piece_type) ? 4 : 2) * square_count + 2;
+    }
+
+    static auto board_slot(int owner, bool is_promoted, int bit) noexcept {
+      return ((is_promoted ? 2 : 0) + owner) * square_count + bit;
+    }
+
+    static auto hand_slot(int piece_type, int owner) noexcept {
+      return slot_count(piece_type) - 2 + owner;
+    }
+
+    static auto is_board_slot(int piece_type, int slot) noexcept {
+      return slot < slot_count(piece_type) - 2;
+    }
+
+    static auto slot_owner(int piece_type, int slot) noexcept {
+      return is_board_slot(piece_type, slot) ? slot / square_count % 2 : slot - (slot_count(piece_type) - 2);
+    }
+
+    static auto slot_bit(int slot) noexcept {
+      return slot % square_count;
+    }
+
+    // 盤上の成った駒のスロットならtrueを返します。持ち駒のスロットは、成れる駒の場合も成っていない駒として扱います。
+
+    static auto is_promoted_slot(int piece_type, int slot) noexcept {
+      return is_board_slot(piece_type, slot) && slot >= 2 * square_count;
+    }
+
+    // 盤上の駒の種類。成っていればにわとりかパワーアップねこです。
+
+    static auto slot_piece_type(int piece_type, int slot) noexcept {
+      return is_promoted_slot(piece_type, slot) ? barium_rules::promoted_pieces[piece_type] : piece_type;
+    }
+
+    static auto size(const signature& piece_counts) noexcept {
+      auto result = std::uint64_t(square_count * square_count);
+
+      for (auto i = 0; i < piece_type_count; ++i) {
+        for (auto j = 0; j < piece_counts[i]; ++j) {
+          result *= slot_count(i);
+        }
+      }
+
+      return result;
+    }
+
+    static auto name(const signature& piece_counts) {
+      auto result = std::string("LL");
+
+      for (auto i = 0; i < piece_type_count; ++i) {
+        result.append(piece_counts[i], barium_rules::pieces[i].character);
+      }
+
+      return result;
+    }
+
+    static auto index(const tablebase_position& position) noexcept {
+      auto result = static_cast<std::uint64_t>(position.lion * square_count + position.enemy_lion);
+
+      for (const auto& [piece_type, slot]: position.pieces) {
+        result = result * slot_count(piece_type) + slot;
+      }
+
+      return result;
+    }
+
+    // indexの局面。駒が重なる場合と、同じ種類の駒のスロットが並んでいない場合（同じ局面の別の番号）は、ありえない局面としてboost::noneを返します。
+
+    static auto to_tablebase_position(const signature& piece_counts, std::uint64_t index) noexcept {
+      auto result = tablebase_position();
+
+      for (auto i = 0; i < piece_type_count; ++i) {
+        for (auto j = 0; j < piece_counts[i]; ++j) {
+          result.pieces.emplace_back(i, 0);
+        }
+      }
+
+      for (auto it = std::rbegin(result.pieces); it != std::rend(result.pieces); ++it) {
+        it->second = static_cast<int>(index % slot_count(it->first));
+        index /= slot_count(it->first);
+      }
+
+      result.lion       = static_cast<int>(index / square_count);
+      result.enemy_lion = static_cast<int>(index % square_count);
+
+      auto occupied_bits = 1u << result.lion;
+
+      if (occupied_bits & 1u << result.enemy_lion) {
+        return boost::optional<tablebase_position>();
+      }
+
+      occupied_bits |= 1u << result.enemy_lion;
+
+      for (auto i = 0; i < static_cast<int>(result.pieces.size()); ++i) {
+        const auto& [piece_type, slot] = result.pieces[i];
+
+        if (i > 0 && result.pieces[i - 1].first == piece_type && result.pieces[i - 1].second > slot) {
+          return boost::optional<tablebase_position>();
+        }
+
+        if (is_board_slot(piece_type, slot)) {
+          if (occupied_bits & 1u << slot_bit(slot)) {
+            return boost::optional<tablebase_position>();
+          }
+
+          occupied_bits |= 1u << slot_bit(slot);
+        }
+      }
+
+      return boost::make_optional(result);
+    }
+
+    static auto to_tablebase_position(const position& position) noexcept {
+      const auto& side = position.side();
+
+      const auto& bit = [&](std::uint32_t bits) {
+        return side ? square_count - 1 - static_cast<int>(_tzcnt_u32(bits)) : static_cast<int>(_tzcnt_u32(bits));
+      };
+
+      auto result = tablebase_position();
+
+      result.lion       = bit(position.pieces_on_board(side    )[barium_rules::king]);
+      result.enemy_lion = bit(position.pieces_on_board(side ^ 1)[barium_rules::king]);
+
+      for (auto owner = 0; owner < 2; ++owner) {
+        for (auto i = 0; i < barium_rules::piece_count; ++i) {
+          if (i == barium_rules::king) {
+            continue;
+          }
+
+          const auto& piece_type = barium_rules::demoted_pieces[i];
+
+          for (auto piece_bits = position.pieces_on_board(side ^ owner)[i]; piece_bits; piece_bits = _blsr_u32(piece_bits)) {
+            result.pieces.emplace_back(piece_type, board_slot(owner, i != piece_type, bit(piece_bits)));
+          }
+        }
+
+        for (auto i = 0; i < piece_type_count; ++i) {
+          for (auto j = 0; j < position.piece_counts_in_hand(side ^ owner)[i]; ++j) {
+            result.pieces.emplace_back(i, hand_slot(i, owner));
+          }
+        }
+      }
+
+      result.sort();
+
+      return result;
+    }
+
+    static auto to_state(const tablebase_position& position) noexcept {
+      auto pieces_on_board            = std::array<std::uint32_t, barium_rules::piece_count>();
+      auto piece_counts_in_hand       = std::array<int,           barium_rules::hand_piece_count>();
+      auto enemy_pieces_on_board      = std::array<std::uint32_t, barium_rules::piece_count>();
+      auto enemy_piece_counts_in_hand = std::array<int,           barium_rules::hand_piece_count>();
+
+      pieces_on_board[barium_rules::king]       = 1u << position.lion;
+      enemy_pieces_on_board[barium_rules::king] = 1u << position.enemy_lion;
+
+      for (const auto& [piece_type, slot]: position.pieces) {
+        if (is_board_slot(piece_type, slot)) {
+          (slot_owner(piece_type, slot) == 0 ? pieces_on_board : enemy_pieces_on_board)[slot_piece_type(piece_type, slot)] |= 1u << slot_bit(slot);
+        } else {
+          (slot_owner(piece_type, slot) == 0 ? piece_counts_in_hand : enemy_piece_counts_in_hand)[piece_type]++;
+        }
+      }
+
+      return state(pieces_on_board, piece_counts_in_hand, enemy_pieces_on_board, enemy_piece_counts_in_hand);
+    }
+
+    // 値を探索の評価値にします。早く勝てる方が高くなるように、ライオンを取るまでの手数を引きます。
+
+    static auto score(std::uint8_t value) noexcept {
+      return value == 0 ? 0 : value % 2 ? 100000 - value : -100000 + value;
+    }
+
+  private:
+    signature _piece_counts;
+    std::uint64_t _size;
+    boost::interprocess::file_mapping _file_mapping;
+    boost::interprocess::mapped_region _mapped_region;
+    const std::uint8_t* _values;
+
+  public:
+    tablebase(const std::string& path)
+      : _piece_counts(), _size(0), _file_mapping(path.c_str(), boost::interprocess::read_only), _mapped_region(_file_mapping, boost::interprocess::read_only), _values(nullptr)
+    {
+      const auto& data = static_cast<const std::uint8_t*>(_mapped_region.get_address());
+
+      if (_mapped_region.get_size() < header_size || std::memcmp(data, "BTB1", 4) != 0) {
+        throw std::runtime_error("invalid tablebase " + path);
+      }
+
+      for (auto i = 0; i < piece_type_count; ++i) {
+        _piece_counts[i] = data[4 + i];
+      }
+
+      std::memcpy(&_size, data + 8, sizeof(_size));
+
+      if (_size != size(_piece_counts) || _mapped_region.get_size() < header_size + _size) {
+        throw std::runtime_error("truncated tablebase " + path);
+      }
+
+      _values = data + header_size;
+    }
+
+    const auto& piece_counts() const noexcept {
+      return _piece_counts;
+    }
+
+    const auto& size() const noexcept {
+      return _size;
+    }
+
+    auto value(std::uint64_t index) const noexcept {
+      return _values[index];
+    }
+
+    auto probe(const position& position) const noexcept {
+      return value(index(to_tablebase_position(position)));
+    }
+  };
+
+  // 読み込んだ終盤データベースの集まり。駒の組み合わせで引きます。
+
+  class tablebases final {
+    std::array<std::unique_ptr<tablebase>, 4 * 4 * 4> _tablebases;
+
+    static auto key(const tablebase::signature& piece_counts) noexcept {
+      return piece_counts[0] + piece_counts[1] * 4 + piece_counts[2] * 16;
+    }
+
+  public:
+    tablebases() noexcept: _tablebases() {
+      ;
+    }
+
+    // directoryにある、駒がmax_piece_count個以下のファイルを全て読み込んで、読み込んだファイルの数を返します。
+
+    auto load(const std::string& directory) {
+      auto result = 0;
+
+      for (auto i = 0; i < 4 * 4 * 4; ++i) {
+        const auto& piece_counts = tablebase::signature{i % 4, i / 4 % 4, i / 16};
+
+        if (piece_counts[0] + piece_counts[1] + piece_counts[2] > tablebase_position::max_piece_count) {
+          continue;
+        }
+
+        const auto& path = directory + "/" + tablebase::name(piece_counts) + ".tbl";
+
+        if (!std::ifstream(path)) {
+          continue;
+        }
+
+        _tablebases[i] = std::make_unique<tablebase>(path);
+        result++;
+      }
+
+      return result;
+    }
+
+    // 駒の組み合わせのデータベース。ない場合はnullptrです。
+
+    const tablebase* find(const tablebase::signature& signature) const noexcept {
+      if (signature[0] + signature[1] + signature[2] > tablebase_position::max_piece_count) {
+        return nullptr;
+      }
+
+      return _tablebases[key(signature)].get();
+    }
+
+    const tablebase* find(const position& position) const noexcept {
+      auto piece_counts = tablebase::signature();
+
+      for (auto side = 0; side < 2; ++side) {
+        for (auto i = 0; i < barium_rules::piece_count; ++i) {
+          if (i != barium_rules::king) {
+            piece_counts[barium_rules::demoted_pieces[i]] += static_cast<int>(_mm_popcnt_u32(position.pieces_on_board(side)[i]));
+          }
+        }
+
+        for (auto i = 0; i < tablebase::piece_type_count; ++i) {
+          piece_counts[i] += position.piece_counts_in_hand(side)[i];
+        }
+      }
+
+      if (position.is_end()) {
+        return nullptr;
+      }
+
+      return find(piece_counts);
+    }
+
+    auto size() const noexcept {
+      return static_cast<int>(std::count_if(std::begin(_tablebases), std::end(_tablebases), [](const auto& tablebase) { return tablebase != nullptr; }));
+    }
+  };
+
+  // 探索で使用する終盤データベース。起動時に、必要ならloadします。
+
+  inline auto& current_tablebases() noexcept {
+    static auto result = tablebases();
+
+    return result;
+  }
+}
@@ -0,0 +1,507 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <immintrin.h>
+
+#include <boost/program_options.hpp>
+
+#include "game.hpp"
+#include "position.hpp"
+#include "tablebase.hpp"
+
+// 終盤データベースの生成。駒の組み合わせ毎に、全局面を後退解析で解きます。
+//
+// 1. ライオンを取れる局面を、1手で勝ちとします。それ以外の局面には、合法手の数を記録します。
+// 2. n手で勝ち負けが決まった局面の一手前の局面（親）を、逆向きの手で生成します。n手で負けの局面の親はn + 1手で勝ちで、n手で勝ちの局面の親は合法手の数を1減らして、
+//    0になったら（どの手を指しても相手の勝ち）n + 1手で負けです。これを、新しく決まる局面がなくなるまで繰り返します。
+// 3. 最後まで決まらなかった局面は、どちらもライオンを取れないので引き分けです。
+//
+// 駒を取っても持ち駒になるだけなので、駒の組み合わせが違うファイルを参照することはありません。
+
+namespace {
+  using barys::barium_rules;
+  using barys::tablebase;
+  using barys::tablebase_position;
+
+  constexpr auto chick = 0;  // 0番の駒はひよこです。
+  constexpr auto lion  = barium_rules::king;
+
+  // マス目毎の駒。piecesの添字で、手番側のライオンは-2、相手側のライオンは-3、駒がない場合は-1です。
+
+  auto squares(const tablebase_position& position) noexcept {
+    auto result = std::array<int, tablebase::square_count>();
+
+    result.fill(-1);
+
+    result[position.lion]       = -2;
+    result[position.enemy_lion] = -3;
+
+    for (auto i = 0; i < static_cast<int>(position.pieces.size()); ++i) {
+      const auto& [piece_type, slot] = position.pieces[i];
+
+      if (tablebase::is_board_slot(piece_type, slot)) {
+        result[tablebase::slot_bit(slot)] = i;
+      }
+    }
+
+    return result;
+  }
+
+  auto owner_bits(const tablebase_position& position, int owner) noexcept {
+    auto result = 1u << (owner == 0 ? position.lion : position.enemy_lion);
+
+    for (const auto& [piece_type, slot]: position.pieces) {
+      if (tablebase::is_board_slot(piece_type, slot) && tablebase::slot_owner(piece_type, slot) == owner) {
+        result |= 1u << tablebase::slot_bit(slot);
+      }
+    }
+
+    return result;
+  }
+
+  // 手番を入れ替えて、相手側から見た向きにします。stateのnextと同じです。
+
+  auto flipped(const tablebase_position& position) noexcept {
+    auto result = tablebase_position{tablebase::square_count - 1 - position.enemy_lion, tablebase::square_count - 1 - position.lion, {}};
+
+    for (const auto& [piece_type, slot]: position.pieces) {
+      if (tablebase::is_board_slot(piece_type, slot)) {
+        result.pieces.emplace_back(piece_type, tablebase::board_slot(tablebase::slot_owner(piece_type, slot) ^ 1, tablebase::is_promoted_slot(piece_type, slot), tablebase::square_count - 1 - tablebase::slot_bit(slot)));
+      } else {
+        result.pieces.emplace_back(piece_type, tablebase::hand_slot(piece_type, tablebase::slot_owner(piece_type, slot) ^ 1));
+      }
+    }
+
+    result.sort();
+
+    return result;
+  }
+
+  // ひよこを打てないマス目。ownerは打つ側で、盤面の向きは手番側から見た向きです。「打ちひよこ詰め」は、is_chick_drop_mateで別に調べます。
+
+  auto chick_banned_bits(const tablebase_position& position, int owner, int excluded_index = -1) noexcept {
+    auto result = owner == 0 ? barium_rules::top_row_bits : barium_rules::bottom_row_bits;
+
+    for (auto i = 0; i < static_cast<int>(position.pieces.size()); ++i) {
+      const auto& [piece_type, slot] = position.pieces[i];
+
+      if (i != excluded_index && piece_type == chick && tablebase::is_board_slot(piece_type, slot) && !tablebase::is_promoted_slot(piece_type, slot) && tablebase::slot_owner(piece_type, slot) == owner) {
+        for (auto bit = tablebase::slot_bit(slot) % barium_rules::width; bit < tablebase::square_count; bit += barium_rules::width) {
+          result |= 1u << bit;
+        }
+      }
+    }
+
+    return result & barium_rules::board_bits;
+  }
+
+  // 手番側が、相手のライオンの前のマス目（to）にひよこを打つと「打ちひよこ詰め」になるならtrueを返します。めったにないので、stateに変換して判定します。
+
+  auto is_chick_drop_mate(const tablebase_position& position, int to) noexcept {
+    return to == position.enemy_lion + barium_rules::width && tablebase::to_state(position).is_chick_drop_mate(to);
+  }
+
+  auto is_lion_capturable(const tablebase_position& position) noexcept {
+    if (barium_rules::side_controls[0][lion][position.lion] & 1u << position.enemy_lion) {
+      return true;
+    }
+
+    for (const auto& [piece_type, slot]: position.pieces) {
+      if (tablebase::is_board_slot(piece_type, slot) && tablebase::slot_owner(piece_type, slot) == 0 && barium_rules::side_controls[0][tablebase::slot_piece_type(piece_type, slot)][tablebase::slot_bit(slot)] & 1u << position.enemy_lion) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // 子の局面（相手側から見た向き）毎にfunctionを呼び出して、合法手の数を返します。ライオンを取れない局面で使用します。
+
+  template <typename Function>
+  auto for_each_child(const tablebase_position& position, const Function& function) noexcept {
+    auto result = 0;
+
+    const auto& squares     = ::squares(position);
+    const auto& vacant_bits = ~owner_bits(position, 0);
+    const auto& empty_bits  = barium_rules::board_bits & vacant_bits & ~owner_bits(position, 1);
+
+    const auto& move = [&](int index, std::uint32_t control_bits) {
+      for (; control_bits; control_bits = _blsr_u32(control_bits)) {
+        const auto& to = static_cast<int>(_tzcnt_u32(control_bits));
+
+        auto child = position;
+
+        if (index < 0) {
+          child.lion = to;
+        } else {
+          auto& [piece_type, slot] = child.pieces[index];
+
+          slot = tablebase::board_slot(0, tablebase::is_promoted_slot(piece_type, slot) || (tablebase::is_promotable(piece_type) && (barium_rules::promotion_bits & 1u << to)), to);
+        }
+
+        if (squares[to] >= 0) {
+          auto& [piece_type, slot] = child.pieces[squares[to]];
+
+          slot = tablebase::hand_slot(piece_type, 0);
+        }
+
+        function(flipped(child));
+        result++;
+      }
+    };
+
+    move(-1, barium_rules::side_controls[0][lion][position.lion] & vacant_bits);
+
+    for (auto i = 0; i < static_cast<int>(position.pieces.size()); ++i) {
+      const auto& [piece_type, slot] = position.pieces[i];
+
+      if (tablebase::is_board_slot(piece_type, slot) && tablebase::slot_owner(piece_type, slot) == 0) {
+        move(i, barium_rules::side_controls[0][tablebase::slot_piece_type(piece_type, slot)][tablebase::slot_bit(slot)] & vacant_bits);
+      }
+    }
+
+    // 打つ手。同じ種類の持ち駒は、どれを打っても同じ局面になります。
+
+    for (auto i = 0; i < static_cast<int>(position.pieces.size()); ++i) {
+      const auto& [piece_type, slot] = position.pieces[i];
+
+      if (slot != tablebase::hand_slot(piece_type, 0) || (i > 0 && position.pieces[i - 1] == position.pieces[i])) {
+        continue;
+      }
+
+      for (auto to_bits = empty_bits & ~(piece_type == chick ? chick_banned_bits(position, 0) : 0u); to_bits; to_bits = _blsr_u32(to_bits)) {
+        if (piece_type == chick && is_chick_drop_mate(position, _tzcnt_u32(to_bits))) {
+          continue;
+        }
+
+        auto child = position;
+
+        child.pieces[i].second = tablebase::board_slot(0, false, _tzcnt_u32(to_bits));
+
+        function(flipped(child));
+        result++;
+      }
+    }
+
+    return result;
+  }
+
+  // 親の局面（相手側から見た向き）毎にfunctionを呼び出します。相手側の駒を動かす前に戻して、取った駒があれば盤上に戻します。
+
+  template <typename Function>
+  auto for_each_parent(const tablebase_position& position, const Function& function) noexcept {
+    const auto& empty_bits = barium_rules::board_bits & ~owner_bits(position, 0) & ~owner_bits(position, 1);
+
+    // 取られた駒を戻します。同じ種類の持ち駒は、どれを戻しても同じ局面になります。
+
+    const auto& uncapture = [&](tablebase_position& parent, int to) {
+      function(flipped(parent));
+
+      for (auto i = 0; i < static_cast<int>(parent.pieces.size()); ++i) {
+        const auto& [piece_type, slot] = parent.pieces[i];
+
+        if (slot != tablebase::hand_slot(piece_type, 1) || (i > 0 && parent.pieces[i - 1] == parent.pieces[i])) {
+          continue;
+        }
+
+        for (const auto& is_promoted: {false, true}) {
+          if (is_promoted && !tablebase::is_promotable(piece_type)) {
+            continue;
+          }
+
+          auto uncaptured_parent = parent;
+
+          uncaptured_parent.pieces[i].second = tablebase::board_slot(0, is_promoted, to);
+          uncaptured_parent.sort();
+
+          function(flipped(uncaptured_parent));
+        }
+      }
+    };
+
+    // 相手側の駒は、利きを逆に辿ったマス目から動いてきました。相手側の利きは手番側の利きを180度回転させたものなので、逆に辿ると手番側の利きになります。
+
+    for (auto from_bits = barium_rules::side_controls[0][lion][position.enemy_lion] & empty_bits; from_bits; from_bits = _blsr_u32(from_bits)) {
+      auto parent = position;
+
+      parent.enemy_lion = _tzcnt_u32(from_bits);
+
+      uncapture(parent, position.enemy_lion);
+    }
+
+    for (auto i = 0; i < static_cast<int>(position.pieces.size()); ++i) {
+      const auto& [piece_type, slot] = position.pieces[i];
+
+      if (!tablebase::is_board_slot(piece_type, slot) || tablebase::slot_owner(piece_type, slot) != 1) {
+        continue;
+      }
+
+      const auto& to = tablebase::slot_bit(slot);
+
+      // 相手側の成れる駒は、相手側の陣地（手番側から見て下の2行）に入ると必ず成ります。
+
+      for (const auto& was_promoted: {false, true}) {
+        const auto& is_promoted = tablebase::is_promoted_slot(piece_type, slot);
+
+        if (was_promoted && !is_promoted) {
+          continue;
+        }
+
+        if (tablebase::is_promotable(piece_type) && !was_promoted && is_promoted != static_cast<bool>(barium_rules::reversed_promotion_bits & 1u << to)) {
+          continue;
+        }
+
+        const auto& from_piece_type = was_promoted ? tablebase::slot_piece_type(piece_type, slot) : piece_type;
+
+        for (auto from_bits = barium_rules::side_controls[0][from_piece_type][to] & empty_bits; from_bits; from_bits = _blsr_u32(from_bits)) {
+          auto parent = position;
+
+          parent.pieces[i].second = tablebase::board_slot(1, was_promoted, _tzcnt_u32(from_bits));
+          parent.sort();
+
+          uncapture(parent, to);
+        }
+      }
+
+      // 打った駒を持ち駒に戻します。
+
+      if (!tablebase::is_promoted_slot(piece_type, slot) && !(piece_type == chick && chick_banned_bits(position, 1, i) & 1u << to)) {
+        auto parent = position;
+
+        parent.pieces[i].second = tablebase::hand_slot(piece_type, 1);
+        parent.sort();
+
+        if (piece_type == chick && is_chick_drop_mate(flipped(parent), tablebase::square_count - 1 - to)) {
+          continue;
+        }
+
+        function(flipped(parent));
+      }
+    }
+  }
+
+  // 生成の統計です。
+
+  struct statistics final {
+    std::uint64_t size;
+    std::uint64_t valid_count;
+    std::uint64_t win_count;
+    std::uint64_t loss_count;
+    int max_distance;
+    double time;
+  };
+
+  // [0, size)をブロックに分けて、空いているスレッドから順にfunction(begin, end)を実行します。
+
+  template <typename Function>
+  auto parallel_for(std::uint64_t size, int thread_count, const Function& function) {
+    constexpr auto block_size = std::uint64_t(1) << 14;
+
+    auto next_block = std::atomic<std::uint64_t>(0);
+
+    const auto& work = [&]() {
+      for (auto begin = next_block.fetch_add(block_size); begin < size; begin = next_block.fetch_add(block_size)) {
+        function(begin, std::min(begin + block_size, size));
+      }
+    };
+
+    auto threads = std::vector<std::thread>();
+
+    for (auto i = 1; i < thread_count; ++i) {
+      threads.emplace_back(work);
+    }
+
+    work();
+
+    for (auto& thread: threads) {
+      thread.join();
+    }
+  }
+
+  auto generate(const tablebase::signature& piece_counts, int thread_count, const std::string& directory) {
+    const auto& starting_time = std::chrono::steady_clock::now();
+    const auto& size          = tablebase::size(piece_counts);
+
+    auto values          = std::make_unique<std::atomic<std::uint8_t>[]>(size);  // ライオンを取るまでの手数。tablebase.hppを参照してください。
+    auto remaining_moves = std::make_unique<std::atomic<std::uint8_t>[]>(size);  // まだ相手の勝ちと決まっていない手の数。
+
+    auto valid_count = std::atomic<std::uint64_t>(0);
+
+    parallel_for(size, thread_count, [&](std::uint64_t begin, std::uint64_t end) {
+      auto count = std::uint64_t(0);
+
+      for (auto index = begin; index < end; ++index) {
+        values[index].store(0, std::memory_order_relaxed);
+        remaining_moves[index].store(0, std::memory_order_relaxed);
+
+        const auto& position = tablebase::to_tablebase_position(piece_counts, index);
+
+        if (!position) {
+          continue;
+        }
+
+        count++;
+
+        if (is_lion_capturable(*position)) {
+          values[index].store(1, std::memory_order_relaxed);
+          continue;
+        }
+
+        remaining_moves[index].store(static_cast<std::uint8_t>(for_each_child(*position, [](const auto&) {})), std::memory_order_relaxed);
+      }
+
+      valid_count += count;
+    });
+
+    // distance手で決まった局面から、親の局面の値を決めます。
+
+    auto max_distance = 0;
+
+    for (auto distance = 1;; ++distance) {
+      if (distance == 255) {
+        throw std::runtime_error("distance overflow in " + tablebase::name(piece_counts));
+      }
+
+      auto count = std::atomic<std::uint64_t>(0);
+
+      parallel_for(size, thread_count, [&](std::uint64_t begin, std::uint64_t end) {
+        auto block_count = std::uint64_t(0);
+
+        for (auto index = begin; index < end; ++index) {
+          if (values[index].load(std::memory_order_relaxed) != distance) {
+            continue;
+          }
+
+          block_count++;
+
+          for_each_parent(*tablebase::to_tablebase_position(piece_counts, index), [&](const auto& parent) {
+            const auto& parent_index = tablebase::index(parent);
+
+            if (distance % 2 == 0 || remaining_moves[parent_index].fetch_sub(1, std::memory_order_relaxed) == 1) {
+              auto expected = std::uint8_t(0);
+
+              values[parent_index].compare_exchange_strong(expected, static_cast<std::uint8_t>(distance + 1), std::memory_order_relaxed);
+            }
+          });
+        }
+
+        count += block_count;
+      });
+
+      if (count == 0) {
+        break;
+      }
+
+      max_distance = distance;
+    }
+
+    // 書き出します。
+
+    auto result = statistics{size, valid_count, 0, 0, max_distance, 0.0};
+
+    auto header = std::array<char, tablebase::header_size>{'B', 'T', 'B', '1', static_cast<char>(piece_counts[0]), static_cast<char>(piece_counts[1]), static_cast<char>(piece_counts[2])};
+
+    std::memcpy(header.data() + 8, &size, sizeof(size));
+
+    auto buffer = std::vector<char>(size);
+
+    for (auto index = std::uint64_t(0); index < size; ++index) {
+      const auto& value = values[index].load(std::memory_order_relaxed);
+
+      buffer[index] = static_cast<char>(value);
+
+      if (value) {
+        (value % 2 ? result.win_count : result.loss_count)++;
+      }
+    }
+
+    const auto& path = directory + "/" + tablebase::name(piece_counts) + ".tbl";
+
+    auto stream = std::ofstream(path, std::ios::binary);
+
+    stream.write(header.data(), header.size());
+    stream.write(buffer.data(), buffer.size());
+
+    if (!stream) {
+      throw std::runtime_error("cannot write " + path);
+    }
+
+    result.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - starting_time).count();
+
+    return result;
+  }
+}
+
+int main(int argc, char** argv) {
+  auto options = boost::program_options::options_description("options");
+  options.add_options()
+    ("help", "print this message")
+    ("pieces", boost::program_options::value<int>()->default_value(2), "maximum number of pieces other than lions (up to 3)")
+    ("threads", boost::program_options::value<int>()->default_value(static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u))), "number of threads")
+    ("output", boost::program_options::value<std::string>()->default_value("."), "directory to write tablebases to");
+
+  auto variables = boost::program_options::variables_map();
+
+  try {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), variables);
+    boost::program_options::notify(variables);
+
+  } catch (const boost::program_options::error& e) {
+    std::cerr << e.what() << std::endl << options << std::endl;
+
+    return 1;
+  }
+
+  if (variables.count("help")) {
+    std::cout << options << std::endl;
+
+    return 0;
+  }
+
+  const auto  piece_count  = std::min(variables["pieces"].as<int>(), tablebase_position::max_piece_count);
+  const auto  thread_count = std::max(variables["threads"].as<int>(), 1);
+  const auto& directory    = variables["output"].as<std::string>();
+
+  try {
+    std::cout << "name            positions        valid      wins    losses     draws  longest    time [s]  positions/s" << std::endl;
+
+    auto total = statistics{0, 0, 0, 0, 0, 0.0};
+
+    for (auto count = 0; count <= piece_count; ++count) {
+      for (auto chick_count = count; chick_count >= 0; --chick_count) {
+        for (auto cat_count = count - chick_count; cat_count >= 0; --cat_count) {
+          const auto& piece_counts = tablebase::signature{chick_count, cat_count, count - chick_count - cat_count};
+          const auto& result       = generate(piece_counts, thread_count, directory);
+
+          std::cout << std::left << std::setw(10) << tablebase::name(piece_counts) << std::right << std::setw(15) << result.size << std::setw(13) << result.valid_count << std::setw(10) << result.win_count << std::setw(10) << result.loss_count << std::setw(10) << result.valid_count - result.win_count - result.loss_count << std::setw(9) << result.max_distance << std::fixed << std::setprecision(3) << std::setw(12) << result.time << std::setprecision(0) << std::setw(13) << (result.time > 0 ? result.valid_count / result.time : 0.0) << std::defaultfloat << std::endl;
+
+          total.size        += result.size;
+          total.valid_count += result.valid_count;
+          total.win_count   += result.win_count;
+          total.loss_count  += result.loss_count;
+          total.time        += result.time;
+          total.max_distance = std::max(total.max_distance, result.max_distance);
+        }
+      }
+    }
+
+    std::cout << "total: " << total.size << " positions, " << total.valid_count << " valid (" << std::fixed << std::setprecision(1) << 100.0 * total.valid_count / std::max(total.size, std::uint64_t(1)) << " %), longest " << total.max_distance << " plies, " << std::setprecision(3) << total.time << " s" << std::defaultfloat << std::endl;
+
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,147 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace barys {
+  // ワークスティーリングのスレッドプール。複数の対局の探索を、決まった数のスレッドで実行します。
+  //
+  // スレッド毎にキューを持たせて、submitは順番にキューに振り分けます。自分のキューが空になったスレッドは、他のスレッドのキューから盗みます。
+  // どのキューも古いタスクから取り出します。全ての対局の1手あたりの時間は同じなので、古い順は締め切りが早い順と同じです。
+
+  class thread_pool final {
+    struct task_queue final {
+      std::mutex                             mutex;
+      std::deque<std::packaged_task<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<task_queue>> _task_queues;
+    std::vector<std::thread>                 _threads;
+    std::mutex                               _mutex;  // 待機用です。キューの中身は、それぞれのキューのmutexで守ります。
+    std::condition_variable                  _condition;
+    std::atomic<int>                         _pending_count;
+    std::atomic<std::size_t>                 _next_queue_index;
+    std::atomic<std::uint64_t>               _steal_count;
+    bool                                     _is_stopped;
+
+    auto pop(std::size_t index, std::packaged_task<void()>& task) noexcept {
+      auto& task_queue = *_task_queues[index];
+
+      const auto& lock = std::lock_guard<std::mutex>(task_queue.mutex);
+
+      if (task_queue.tasks.empty()) {
+        return false;
+      }
+
+      task = std::move(task_queue.tasks.front());
+      task_queue.tasks.pop_front();
+
+      _pending_count.fetch_sub(1, std::memory_order_relaxed);
+
+      return true;
+    }
+
+    auto run(std::size_t index) noexcept {
+      for (;;) {
+        auto task = std::packaged_task<void()>();
+
+        if (pop(index, task)) {
+          task();
+          continue;
+        }
+
+        auto is_stolen = false;
+
+        for (auto i = std::size_t(1); i < _task_queues.size() && !is_stolen; ++i) {
+          is_stolen = pop((index + i) % _task_queues.size(), task);
+        }
+
+        if (is_stolen) {
+          _steal_count.fetch_add(1, std::memory_order_relaxed);
+
+          task();
+          continue;
+        }
+
+        auto lock = std::unique_lock<std::mutex>(_mutex);
+
+        _condition.wait(lock, [&]() { return _is_stopped || _pending_count.load(std::memory_order_relaxed) > 0; });
+
+        if (_is_stopped && _pending_count.load(std::memory_order_relaxed) == 0) {
+          return;
+        }
+      }
+    }
+
+  public:
+    thread_pool(int thread_count) noexcept: _task_queues(), _threads(), _mutex(), _condition(), _pending_count(0), _next_queue_index(0), _steal_count(0), _is_stopped(false) {
+      for (auto i = 0; i < std::max(thread_count, 1); ++i) {
+        _task_queues.emplace_back(std::make_unique<task_queue>());
+      }
+
+      for (auto i = std::size_t(0); i < _task_queues.size(); ++i) {
+        _threads.emplace_back([&, i]() { run(i); });
+      }
+    }
+
+    // 残っているタスクを全て実行してから終了します。
+
+    ~thread_pool() {
+      {
+        const auto& lock = std::lock_guard<std::mutex>(_mutex);
+
+        _is_stopped = true;
+      }
+
+      _condition.notify_all();
+
+      for (auto& thread: _threads) {
+        thread.join();
+      }
+    }
+
+    auto thread_count() const noexcept {
+      return static_cast<int>(_threads.size());
+    }
+
+    auto steal_count() const noexcept {
+      return _steal_count.load(std::memory_order_relaxed);
+    }
+
+    // functionを実行するタスクを追加します。終了を待つためのfutureを返します。
+
+    template <typename Function>
+    auto submit(Function&& function) {
+      auto task   = std::packaged_task<void()>(std::forward<Function>(function));
+      auto result = task.get_future();
+
+      {
+        auto& task_queue = *_task_queues[_next_queue_index.fetch_add(1, std::memory_order_relaxed) % _task_queues.size()];
+
+        const auto& lock = std::lock_guard<std::mutex>(task_queue.mutex);
+
+        task_queue.tasks.emplace_back(std::move(task));
+      }
+
+      {
+        const auto& lock = std::lock_guard<std::mutex>(_mutex);  // 待機に入ろうとしているスレッドが通知を取りこぼさないように、ロックの中で数えます。
+
+        _pending_count.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      _condition.notify_one();
+
+      return result;
+    }
+  };
+}
@@ -0,0 +1,384 @@
+﻿#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "alpha_beta.hpp"
+#include "game.hpp"
+#include "notation.hpp"
+#include "search_control.hpp"
+#include "tablebase.hpp"
+#include "transposition_table.hpp"
+
+// 自己対戦。2つの設定（深さ、時間、選択的探索の有無）のエンジンを対戦させて、勝敗とEloレーティングの差を出力します。
+//
+// 開始局面毎に先手と後手を入れ替えて2局ずつ対局するので、開始局面の有利不利は打ち消されます。対局は全てのコアで並列に進めます。
+// 同じ局面が3回現れた場合と、max_plies手に達した場合は引き分けです。
+
+namespace {
+  // エンジンの設定。"time=100,depth=8,no-lmr"のような、カンマ区切りの文字列で指定します。
+
+  struct engine final {
+    std::string name;
+    int time_in_ms;
+    int depth;
+    int thread_count;
+    barys::search_options options;
+  };
+
+  auto parse_engine(const std::string& string) {
+    auto result = engine{string, 0, barys::alpha_beta::max_depth, 1, barys::search_options()};
+
+    auto stream = std::stringstream(); stream << string;
+
+    for (auto item = std::string(); std::getline(stream, item, ',');) {
+      if (item.empty()) {
+        continue;
+      }
+
+      const auto& separator = item.find('=');
+      const auto& key       = item.substr(0, separator);
+      const auto& value     = separator == std::string::npos ? std::string() : item.substr(separator + 1);
+
+      if (key == "time" && !value.empty()) {
+        result.time_in_ms = std::stoi(value);
+      } else if (key == "depth" && !value.empty()) {
+        result.depth = std::stoi(value);
+      } else if (key == "threads" && !value.empty()) {
+        result.thread_count = std::stoi(value);
+      } else if (item == "no-pvs") {
+        result.options.is_principal_variation_search_enabled = false;
+      } else if (item == "no-aspiration") {
+        result.options.is_aspiration_window_enabled = false;
+      } else if (item == "no-null-move") {
+        result.options.is_null_move_pruning_enabled = false;
+      } else if (item == "no-lmr") {
+        result.options.is_late_move_reduction_enabled = false;
+      } else if (item == "batch-eval") {
+        result.options.is_batch_evaluation_enabled = true;
+      } else {
+        throw std::runtime_error("unknown engine option: " + item);
+      }
+    }
+
+    if (result.time_in_ms <= 0 && result.depth >= barys::alpha_beta::max_depth) {
+      throw std::runtime_error("engine needs time or depth: " + string);
+    }
+
+    return result;
+  }
+
+  // エンジン毎の集計。
+
+  struct engine_statistics final {
+    std::uint64_t move_count;
+    std::uint64_t node_count;  // 静止探索のノードも含みます。
+    double time;
+    std::vector<double> move_times;  // 1手毎の時間（ミリ秒）。
+
+    auto add(const engine_statistics& other) {
+      move_count += other.move_count;
+      node_count += other.node_count;
+      time       += other.time;
+
+      move_times.insert(std::end(move_times), std::begin(other.move_times), std::end(other.move_times));
+    }
+  };
+
+  // 対局の結果。winnerは勝ったエンジン（0か1）で、引き分けの場合は-1です。
+
+  struct game_result final {
+    int winner;
+    int ply_count;
+    std::array<engine_statistics, 2> statistics;
+  };
+
+  // 開始局面。positionsを指定しない場合は、初期局面からrandom_plies手をランダムに指した局面を使います。乱数の種は固定なので、毎回同じ局面になります。
+
+  auto read_openings(const std::string& path) {
+    auto result = std::vector<barys::state>();
+
+    auto stream = std::ifstream(path);
+
+    if (!stream) {
+      throw std::runtime_error("cannot open " + path);
+    }
+
+    for (auto line = std::string(); std::getline(stream, line);) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+
+      if (line.empty() || line.front() == '#') {
+        continue;
+      }
+
+      result.emplace_back(barys::to_state(line));
+    }
+
+    if (result.empty()) {
+      throw std::runtime_error("no positions in " + path);
+    }
+
+    return result;
+  }
+
+  auto random_openings(int count, int random_plies, std::uint32_t seed) {
+    auto result = std::vector<barys::state>();
+
+    auto random_engine = std::mt19937(seed);
+
+    while (static_cast<int>(result.size()) < count) {
+      auto state = barys::state();
+
+      for (auto ply = 0; ply < random_plies && !state.is_end(); ++ply) {
+        const auto& actions = state.actions();
+
+        state = state.next(actions[random_engine() % actions.size()]);
+      }
+
+      if (!state.is_end()) {
+        result.emplace_back(state);
+      }
+    }
+
+    return result;
+  }
+
+  // 1局対局します。engines[0]が先に指します。
+
+  auto play(const barys::state& opening, const std::array<const engine*, 2>& engines, std::array<barys::transposition_table*, 2>& transposition_tables, int max_plies) {
+    auto result = game_result{-1, 0, {}};
+
+    auto state       = opening;
+    auto repetitions = std::map<std::pair<std::uint64_t, int>, int>();  // 手番も区別するので、手数の偶奇と組にします。
+
+    for (auto& transposition_table: transposition_tables) {
+      transposition_table->clear();
+    }
+
+    for (auto ply = 0; ply < max_plies; ++ply) {
+      if (++repetitions[std::make_pair(state.hash(), ply % 2)] >= 3) {
+        return result;
+      }
+
+      const auto& engine     = *engines[ply % 2];
+      auto&       statistics = result.statistics[ply % 2];
+
+      const auto& starting_time = std::chrono::steady_clock::now();
+
+      auto search_control = barys::search_control(engine.time_in_ms > 0 ? starting_time + std::chrono::milliseconds(engine.time_in_ms) : std::chrono::steady_clock::time_point::max());
+
+      auto search = barys::alpha_beta(state, search_control, *transposition_tables[ply % 2], engine.thread_count, engine.depth, engine.options);
+      const auto& action = search();
+
+      const auto& time = std::chrono::duration<double>(std::chrono::steady_clock::now() - starting_time).count();
+
+      statistics.move_count++;
+      statistics.node_count += search.node_count() + search.quiescence_node_count();
+      statistics.time       += time;
+      statistics.move_times.emplace_back(time * 1000);
+
+      state = state.next(action);
+      result.ply_count = ply + 1;
+
+      if (state.is_end()) {  // 相手のライオンを取ったので、指した側の勝ちです。
+        result.winner = ply % 2;
+
+        return result;
+      }
+    }
+
+    return result;
+  }
+
+  // 勝率からEloレーティングの差を計算します。
+
+  auto elo(double score) noexcept {
+    const auto clamped_score = std::min(std::max(score, 1e-6), 1 - 1e-6);
+
+    return -400 * std::log10(1 / clamped_score - 1);
+  }
+
+  auto percentile(const std::vector<double>& sorted_values, double rate) noexcept {
+    return sorted_values.empty() ? 0.0 : sorted_values[std::min(static_cast<std::size_t>(rate * sorted_values.size()), sorted_values.size() - 1)];
+  }
+}
+
+int main(int argc, char** argv) {
+  auto options = boost::program_options::options_description("options");
+  options.add_options()
+    ("help", "print this message")
+    ("first", boost::program_options::value<std::string>()->default_value("time=100"), "first engine, comma separated: time=<ms>, depth=<n>, threads=<n>, no-pvs, no-aspiration, no-null-move, no-lmr, batch-eval (experimental)")
+    ("second", boost::program_options::value<std::string>()->default_value("time=100"), "second engine, same format as --first")
+    ("games", boost::program_options::value<int>()->default_value(1000), "number of games (rounded up to an even number so that every opening is played with both colors)")
+    ("positions", boost::program_options::value<std::string>(), "file with one opening position per line (default: random openings)")
+    ("random-plies", boost::program_options::value<int>()->default_value(4), "random plies from the initial position for random openings")
+    ("seed", boost::program_options::value<std::uint32_t>()->default_value(0), "random seed for random openings")
+    ("max-plies", boost::program_options::value<int>()->default_value(256), "adjudicate the game as a draw after this many plies")
+    ("hash", boost::program_options::value<std::size_t>()->default_value(16), "transposition table size in MB per engine per game thread")
+    ("threads", boost::program_options::value<int>()->default_value(static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u))), "number of games to play in parallel")
+    ("tablebases", boost::program_options::value<std::string>(), "directory with endgame tablebases made by tablebase-generator")
+    ("json", "print results as JSON");
+
+  auto variables = boost::program_options::variables_map();
+
+  try {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), variables);
+    boost::program_options::notify(variables);
+
+  } catch (const boost::program_options::error& e) {
+    std::cerr << e.what() << std::endl << options << std::endl;
+
+    return 1;
+  }
+
+  if (variables.count("help")) {
+    std::cout << options << std::endl;
+
+    return 0;
+  }
+
+  try {
+    if (variables.count("tablebases")) {
+      barys::current_tablebases().load(variables["tablebases"].as<std::string>());
+    }
+
+    const auto& engines = std::array<engine, 2>{parse_engine(variables["first"].as<std::string>()), parse_engine(variables["second"].as<std::string>())};
+
+    const auto  game_count   = (std::max(variables["games"].as<int>(), 2) + 1) / 2 * 2;
+    const auto  max_plies    = std::max(variables["max-plies"].as<int>(), 1);
+    const auto  thread_count = std::max(variables["threads"].as<int>(), 1);
+    const auto& is_json      = variables.count("json") > 0;
+
+    const auto& openings = variables.count("positions") ? read_openings(variables["positions"].as<std::string>()) : random_openings(game_count / 2, variables["random-plies"].as<int>(), variables["seed"].as<std::uint32_t>());
+
+    const auto& starting_time = std::chrono::steady_clock::now();
+
+    // 結果は、firstから見た勝ち、引き分け、負けの数です。
+
+    auto win_count  = 0;
+    auto draw_count = 0;
+    auto loss_count = 0;
+    auto ply_count  = std::uint64_t(0);
+    auto statistics = std::array<engine_statistics, 2>{};
+
+    auto next_index = std::atomic<int>(0);
+    auto mutex      = std::mutex();
+
+    const auto& work = [&]() {
+      auto transposition_tables = std::array<barys::transposition_table, 2>{barys::transposition_table(variables["hash"].as<std::size_t>()), barys::transposition_table(variables["hash"].as<std::size_t>())};
+
+      for (auto i = next_index++; i < game_count; i = next_index++) {
+        // 偶数番目の対局ではfirstが、奇数番目の対局ではsecondが先に指します。
+
+        const auto& is_swapped = i % 2 == 1;
+
+        auto game_engines              = std::array<const engine*, 2>{&engines[0], &engines[1]};
+        auto game_transposition_tables = std::array<barys::transposition_table*, 2>{&transposition_tables[0], &transposition_tables[1]};
+
+        if (is_swapped) {
+          std::swap(game_engines[0], game_engines[1]);
+          std::swap(game_transposition_tables[0], game_transposition_tables[1]);
+        }
+
+        const auto& result = play(openings[(i / 2) % openings.size()], game_engines, game_transposition_tables, max_plies);
+
+        const auto lock = std::lock_guard<std::mutex>(mutex);
+
+        const auto& first_result = result.winner == -1 ? 0 : ((result.winner == 0) != is_swapped ? 1 : -1);
+
+        win_count  += first_result ==  1;
+        draw_count += first_result ==  0;
+        loss_count += first_result == -1;
+        ply_count  += result.ply_count;
+
+        statistics[0].add(result.statistics[is_swapped ? 1 : 0]);
+        statistics[1].add(result.statistics[is_swapped ? 0 : 1]);
+
+        std::cerr << "game " << i + 1 << " / " << game_count << ": " << (first_result == 1 ? "first wins" : first_result == -1 ? "second wins" : "draw") << " in " << result.ply_count << " plies (" << win_count << " - " << draw_count << " - " << loss_count << ")" << std::endl;
+      }
+    };
+
+    auto threads = std::vector<std::thread>();
+
+    for (auto i = 1; i < thread_count; ++i) {
+      threads.emplace_back(work);
+    }
+
+    work();
+
+    for (auto& thread: threads) {
+      thread.join();
+    }
+
+    const auto& time = std::chrono::duration<double>(std::chrono::steady_clock::now() - starting_time).count();
+
+    // 1局毎の得点（1、0.5、0）の標準誤差から、95%の信頼区間を求めます。
+
+    const auto& score    = (win_count + draw_count * 0.5) / game_count;
+    const auto& variance = (win_count * std::pow(1 - score, 2) + draw_count * std::pow(0.5 - score, 2) + loss_count * std::pow(score, 2)) / game_count;
+    const auto& margin   = 1.96 * std::sqrt(variance / game_count);
+
+    const auto& elo_difference = elo(score);
+    const auto& elo_error      = (elo(score + margin) - elo(score - margin)) / 2;
+    const auto& los            = win_count + loss_count > 0 ? 0.5 * (1 + std::erf((win_count - loss_count) / std::sqrt(2.0 * (win_count + loss_count)))) : 0.5;  // firstの方が強い確率（likelihood of superiority）。
+
+    for (auto& engine_statistics: statistics) {
+      std::sort(std::begin(engine_statistics.move_times), std::end(engine_statistics.move_times));
+    }
+
+    const auto& nodes_per_second = [&](const engine_statistics& engine_statistics) {
+      return engine_statistics.time > 0 ? engine_statistics.node_count / engine_statistics.time : 0.0;
+    };
+
+    const auto& mean_move_time = [&](const engine_statistics& engine_statistics) {
+      return engine_statistics.move_count ? engine_statistics.time * 1000 / engine_statistics.move_count : 0.0;
+    };
+
+    if (is_json) {
+      std::cout << "{\"games\": " << game_count << ", \"wins\": " << win_count << ", \"draws\": " << draw_count << ", \"losses\": " << loss_count << ", \"score\": " << score << ", \"elo\": " << elo_difference << ", \"elo_error\": " << elo_error << ", \"los\": " << los << ", \"average_plies\": " << static_cast<double>(ply_count) / game_count << ", \"time\": " << time << ", \"engines\": [";
+
+      for (auto i = 0; i < 2; ++i) {
+        const auto& engine_statistics = statistics[i];
+
+        std::cout << (i ? ", " : "") << "{\"name\": \"" << engines[i].name << "\", \"moves\": " << engine_statistics.move_count << ", \"nodes_per_second\": " << nodes_per_second(engine_statistics) << ", \"move_time_ms\": {\"mean\": " << mean_move_time(engine_statistics) << ", \"p50\": " << percentile(engine_statistics.move_times, 0.5) << ", \"p90\": " << percentile(engine_statistics.move_times, 0.9) << ", \"p99\": " << percentile(engine_statistics.move_times, 0.99) << ", \"max\": " << (engine_statistics.move_times.empty() ? 0.0 : engine_statistics.move_times.back()) << "}}";
+      }
+
+      std::cout << "]}" << std::endl;
+
+    } else {
+      std::cout << "games: " << game_count << ", first - draw - second: " << win_count << " - " << draw_count << " - " << loss_count << ", average plies: " << std::fixed << std::setprecision(1) << static_cast<double>(ply_count) / game_count << ", time: " << time << " s" << std::endl;
+      std::cout << "score: " << std::setprecision(3) << score << ", elo: " << std::showpos << std::setprecision(1) << elo_difference << std::noshowpos << " +/- " << elo_error << " (95%), los: " << std::setprecision(3) << los << std::endl;
+
+      for (auto i = 0; i < 2; ++i) {
+        const auto& engine_statistics = statistics[i];
+
+        std::cout << (i ? "second" : "first") << " (" << engines[i].name << "): moves = " << engine_statistics.move_count << ", nodes/s = " << std::setprecision(0) << nodes_per_second(engine_statistics) << std::setprecision(1) << ", move time (ms): mean = " << mean_move_time(engine_statistics) << ", p50 = " << percentile(engine_statistics.move_times, 0.5) << ", p90 = " << percentile(engine_statistics.move_times, 0.9) << ", p99 = " << percentile(engine_statistics.move_times, 0.99) << ", max = " << (engine_statistics.move_times.empty() ? 0.0 : engine_statistics.move_times.back()) << std::endl;
+      }
+    }
+
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+
+    return 1;
+  }
+
+  return 0;
+}
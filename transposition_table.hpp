@@ -0,0 +1,176 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <boost/optional.hpp>
+
+#include "move.hpp"
+
+namespace barys {
+  enum class bound_type: std::uint8_t {none = 0, exact = 1, lower = 2, upper = 3};
+
+  // 複数のスレッドから同時に使用するので、ロックを使わずにキーとデータをXORして格納します（ハイアットの方式）。
+  // 書き込みが混ざってしまったエントリーはキーが一致しなくなるので、単に無視されます。
+
+  class transposition_table final {
+  public:
+    class entry final {
+      std::uint64_t _key;
+      std::uint64_t _data;  // 下位から順に、評価値32ビット、手16ビット、深さ8ビット、bound_type2ビット、世代6ビットです。
+
+    public:
+      entry(std::uint64_t key, std::uint64_t data) noexcept: _key(key), _data(data) {
+        ;
+      }
+
+      template <typename Move>
+      entry(std::uint64_t key, int score, const Move& move, int depth, bound_type bound, int generation) noexcept
+        : entry(key,
+                static_cast<std::uint64_t>(static_cast<std::uint32_t>(score)) |
+                static_cast<std::uint64_t>(move.value()) << 32 |
+                static_cast<std::uint64_t>(static_cast<std::uint8_t>(depth)) << 48 |
+                static_cast<std::uint64_t>(generation << 2 | static_cast<int>(bound)) << 56)
+      {
+        ;
+      }
+
+      auto key() const noexcept {
+        return _key;
+      }
+
+      auto data() const noexcept {
+        return _data;
+      }
+
+      auto score() const noexcept {
+        return static_cast<int>(static_cast<std::int32_t>(_data & 0xffffffff));
+      }
+
+      // 手はRulesに依らず16ビットなので、取り出す時に手の型を指定します。
+
+      template <typename Move = barys::move>
+      auto move() const noexcept {
+        return Move(static_cast<std::uint16_t>(_data >> 32 & 0xffff));
+      }
+
+      auto depth() const noexcept {
+        return static_cast<int>(static_cast<std::int8_t>(_data >> 48 & 0xff));
+      }
+
+      auto bound() const noexcept {
+        return static_cast<bound_type>(_data >> 56 & 0b11);
+      }
+
+      auto generation() const noexcept {
+        return static_cast<int>(_data >> 58);
+      }
+    };
+
+  private:
+    struct alignas(64) bucket final {  // 1バケットを1キャッシュ・ラインに収めます。
+      std::array<std::atomic<std::uint64_t>, 4 * 2> words;  // キーとデータをXORした値と、データの組が4つです。
+    };
+
+    std::unique_ptr<bucket[]> _buckets;
+    std::uint64_t             _mask;
+    std::atomic<int>          _generation;  // 複数の対局の探索が同時にnew_searchを呼び出す場合があるので、atomicにしておきます。
+
+  public:
+    transposition_table(std::size_t size_in_mb) noexcept: _generation(0) {
+      auto bucket_count = std::size_t(1);
+
+      while (bucket_count * 2 * sizeof(bucket) <= size_in_mb * 1024 * 1024) {
+        bucket_count *= 2;
+      }
+
+      _buckets = std::unique_ptr<bucket[]>(new bucket[bucket_count]());
+      _mask    = bucket_count - 1;
+    }
+
+    auto size() const noexcept {
+      return (_mask + 1) * sizeof(bucket);
+    }
+
+    auto new_search() noexcept {
+      _generation.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto clear() noexcept {
+      for (auto i = std::uint64_t(0); i <= _mask; ++i) {
+        for (auto& word: _buckets[i].words) {
+          word.store(0, std::memory_order_relaxed);
+        }
+      }
+    }
+
+  private:
+    auto generation() const noexcept {
+      return _generation.load(std::memory_order_relaxed) & 0b111111;
+    }
+
+    auto load(const bucket& bucket, int index) const noexcept {
+      const auto& data = bucket.words[index * 2 + 1].load(std::memory_order_relaxed);
+
+      return entry(bucket.words[index * 2].load(std::memory_order_relaxed) ^ data, data);
+    }
+
+    auto replacement_priority(const entry& entry) const noexcept {
+      return entry.depth() - ((generation() - entry.generation()) & 0b111111) * 4;  // 古い世代のエントリーから置き換えます。
+    }
+
+  public:
+    auto probe(std::uint64_t key) const noexcept {
+      const auto& bucket = _buckets[key & _mask];
+
+      for (auto i = 0; i < 4; ++i) {
+        const auto& entry = load(bucket, i);
+
+        if (entry.key() == key && entry.bound() != bound_type::none) {
+          return boost::optional<transposition_table::entry>(entry);
+        }
+      }
+
+      return boost::optional<transposition_table::entry>();
+    }
+
+    // 別の局面のエントリーを追い出した場合はtrueを返します。
+
+    template <typename Move>
+    auto store(std::uint64_t key, int score, const Move& move, int depth, bound_type bound) noexcept {
+      auto& bucket = _buckets[key & _mask];
+
+      auto target_index    = 0;
+      auto target_priority = 1000000;
+
+      for (auto i = 0; i < 4; ++i) {
+        const auto& entry = load(bucket, i);
+
+        if (entry.key() == key || entry.bound() == bound_type::none) {  // 同じ局面か空きがあれば、そこを使います。
+          if (entry.key() == key && entry.depth() > depth && bound != bound_type::exact && entry.generation() == generation()) {
+            return false;
+          }
+
+          target_index    = i;
+          target_priority = -1000000;
+
+          break;
+        }
+
+        if (replacement_priority(entry) < target_priority) {
+          target_index    = i;
+          target_priority = replacement_priority(entry);
+        }
+      }
+
+      const auto& entry = transposition_table::entry(key, score, move, depth, bound, generation());
+
+      bucket.words[target_index * 2    ].store(entry.key() ^ entry.data(), std::memory_order_relaxed);
+      bucket.words[target_index * 2 + 1].store(entry.data(),               std::memory_order_relaxed);
+
+      return target_priority != -1000000;
+    }
+  };
+}